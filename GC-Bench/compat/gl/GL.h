@@ -0,0 +1 @@
+#include <GL/gl.h>
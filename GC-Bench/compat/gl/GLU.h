@@ -0,0 +1 @@
+#include <GL/glu.h>
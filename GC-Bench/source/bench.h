@@ -0,0 +1,161 @@
+/*****************************************************************************************************
+ Copyright (c) 2015 Gorka Surez Garca
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*****************************************************************************************************/
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------
+// Bench
+//----------------------------------------------------------------------------------------------------
+
+// Measures the throughput of a kernel over a batch of items and checks the SIMD paths against
+// the scalar ones. Every measure is repeated until it takes a minimum time, and the best of some
+// runs is kept, so the results are stable enough to compare between versions.
+
+class Bench {
+public:
+    struct Result {
+        std::string project, name;
+        std::size_t batch, repetitions;
+        double nanosecondsPerItem;
+    };
+
+    struct Check {
+        std::string project, name;
+        double error, tolerance;
+        bool passed;
+    };
+
+private:
+    std::string project_;
+    std::vector<Result> results_;
+    std::vector<Check> checks_;
+    std::vector<std::size_t> batches_;
+    double minimumSeconds_;
+    int runs_;
+    std::mt19937 random_;
+
+public:
+    static volatile std::uint32_t Sink;
+
+    Bench(bool quick) : project_(), results_(), checks_(), batches_(), minimumSeconds_(quick ? 0.005 : 0.05),
+        runs_(quick ? 2 : 5), random_(12345) {
+        batches_.push_back(16);
+        batches_.push_back(256);
+        batches_.push_back(4096);
+        batches_.push_back(65536);
+    }
+
+    const std::vector<std::size_t> & Batches() const { return batches_; }
+    std::size_t MaxBatch() const { return batches_.back(); }
+
+    void Project(const std::string & value) { project_ = value; }
+
+    float Random(float low, float high) {
+        return std::uniform_real_distribution<float>(low, high)(random_);
+    }
+
+    // Keeps the compiler from removing the work of a kernel:
+    template <typename T>
+    static void Consume(const T & value) {
+        const unsigned char * bytes = reinterpret_cast<const unsigned char *>(&value);
+        std::uint32_t hash = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            hash = hash * 31 + bytes[i];
+        }
+        Sink = Sink + hash;
+    }
+
+    template <typename F>
+    void Measure(const std::string & name, std::size_t batch, F kernel) {
+        typedef std::chrono::steady_clock Clock;
+        std::size_t repetitions = 1;
+        double best = 0.0;
+        // Find how many repetitions are needed to reach the minimum time:
+        for (;;) {
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < repetitions; ++i) {
+                kernel(batch);
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds >= minimumSeconds_) {
+                best = seconds;
+                break;
+            }
+            repetitions *= 2;
+        }
+        // Keep the best of the runs:
+        for (int k = 1; k < runs_; ++k) {
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < repetitions; ++i) {
+                kernel(batch);
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds < best) {
+                best = seconds;
+            }
+        }
+        Result result = { project_, name, batch, repetitions,
+            best * 1e9 / static_cast<double>(repetitions * batch) };
+        results_.push_back(result);
+    }
+
+    template <typename F>
+    void MeasureBatches(const std::string & name, F kernel) {
+        for (auto batch : batches_) {
+            Measure(name, batch, kernel);
+        }
+    }
+
+    void Verify(const std::string & name, double error, double tolerance) {
+        Check check = { project_, name, error, tolerance, error <= tolerance };
+        checks_.push_back(check);
+    }
+
+    bool Passed() const {
+        for (auto & check : checks_) {
+            if (!check.passed) return false;
+        }
+        return true;
+    }
+
+    void WriteJson(std::ostream & output) const;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Suites
+//----------------------------------------------------------------------------------------------------
+
+void RunPractice1(Bench & bench);
+void RunPractice2(Bench & bench);
+void RunPractice3(Bench & bench);
+
+#endif
@@ -0,0 +1,308 @@
+/*****************************************************************************************************
+ Copyright (c) 2015 Gorka Surez Garca
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*****************************************************************************************************/
+
+#include "bench.h"
+#include "../../GC-P01/source/gsystem.h"
+#include "../../GC-P01/source/gentity.h"
+#include <algorithm>
+#include <thread>
+
+//****************************************************************************************************
+// Practice 1: gsystem (Point3, Vector3, Quaternion, Matrix)
+//****************************************************************************************************
+
+static double MaxError(const Coordinates & lhs, const Coordinates & rhs) {
+    double error = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        error = std::max(error, static_cast<double>(std::fabs(lhs.Get()[i] - rhs.Get()[i])));
+    }
+    return error;
+}
+
+static void ReferenceMultiply(const GLfloat * lhs, const GLfloat * rhs, GLfloat * result) {
+    // Column-major 4x4 product without SIMD:
+    for (int j = 0; j < 4; ++j) {
+        for (int i = 0; i < 4; ++i) {
+            GLfloat value = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                value += lhs[k * 4 + i] * rhs[j * 4 + k];
+            }
+            result[j * 4 + i] = value;
+        }
+    }
+}
+
+static void MakeCloud(Bench & bench, GravitySystem & system, std::size_t count, GLfloat centralMass) {
+    // Bodies in a disc with circular velocities around a central mass, or a still cloud without it:
+    const GLfloat ORIGIN[3] = { 0.0f, 0.0f, 0.0f };
+    GLfloat mass = centralMass > 0.0f ? centralMass * 1e-3f / count : 1.0f / count;
+    if (centralMass > 0.0f) {
+        system.Add(ORIGIN, ORIGIN, centralMass);
+    }
+    for (std::size_t i = system.Size(); i < count; ++i) {
+        GLfloat radius = bench.Random(20, 100), angle = bench.Random(-PI, PI);
+        GLfloat position[3] = { radius * std::cos(angle), bench.Random(-2, 2), -radius * std::sin(angle) };
+        GLfloat speed = centralMass > 0.0f ? std::sqrt(centralMass / radius) : 0.0f;
+        GLfloat velocity[3] = { -speed * std::sin(angle), 0.0f, -speed * std::cos(angle) };
+        if (centralMass <= 0.0f) {
+            position[1] = bench.Random(-50, 50);
+        }
+        system.Add(position, velocity, mass);
+    }
+}
+
+void RunPractice1(Bench & bench) {
+    bench.Project("GC-P01");
+    const std::size_t size = bench.MaxBatch();
+
+    std::vector<Vector3> va(size), vb(size), vr(size), vs(size);
+    std::vector<Point3> pa(size);
+    std::vector<Quaternion> qa(size), qb(size), qr(size), qs(size);
+    std::vector<Matrix> ma(size), mb(size), mr(size);
+    std::vector<GLfloat> angles(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        va[i].Set(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10));
+        vb[i].Set(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10));
+        pa[i].Set(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10));
+        Vector3 axis(bench.Random(-1, 1), bench.Random(-1, 1), bench.Random(1, 2));
+        qa[i] = Quaternion::FromAxisAngle(axis, bench.Random(-180, 180));
+        qb[i] = Quaternion::FromAxisAngle(axis.Cross(Vector3::UP) + axis, bench.Random(-180, 180));
+        ma[i].SetAsRotate(bench.Random(-180, 180), axis.X(), axis.Y(), axis.Z());
+        ma[i].AddTranslate(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10));
+        mb[i].SetAsScale(bench.Random(0.5f, 2), bench.Random(0.5f, 2), bench.Random(0.5f, 2));
+        mb[i].AddRotate(bench.Random(-180, 180), 0.0f, 1.0f, 0.0f);
+        angles[i] = bench.Random(-100, 100);
+    }
+
+    // Vector3:
+    bench.MeasureBatches("vector3_add_scaled", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] = va[i] + vb[i] * 0.5f;
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+    bench.MeasureBatches("vector3_cross_dot", [&] (std::size_t n) {
+        GLfloat sum = 0.0f;
+        for (std::size_t i = 0; i < n; ++i) {
+            sum += va[i].Cross(vb[i]).Dot(va[i]);
+        }
+        Bench::Consume(sum);
+    });
+    bench.MeasureBatches("point3_add_scaled_in_place", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            pa[i].AddScaled(va[i], 1e-3f);
+        }
+        Bench::Consume(pa[n - 1]);
+    });
+
+    // Quaternion:
+    bench.MeasureBatches("quaternion_multiply", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            qr[i] = qa[i] * qb[i];
+        }
+        Bench::Consume(qr[n - 1]);
+    });
+    bench.MeasureBatches("quaternion_rotate_scalar", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vs[i] = qa[0].Rotate(va[i]);
+        }
+        Bench::Consume(vs[n - 1]);
+    });
+    bench.MeasureBatches("quaternion_rotate_batch", [&] (std::size_t n) {
+        Quaternion::Rotate(qa[0], va.data(), vr.data(), n);
+        Bench::Consume(vr[n - 1]);
+    });
+    double error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, MaxError(qa[0].Rotate(va[i]), vr[i]));
+    }
+    bench.Verify("quaternion_rotate_batch", error, 1e-4);
+
+    bench.MeasureBatches("quaternion_slerp_scalar", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            qs[i] = Quaternion::Slerp(qa[i], qb[i], 0.3f);
+        }
+        Bench::Consume(qs[n - 1]);
+    });
+    bench.MeasureBatches("quaternion_slerp_batch", [&] (std::size_t n) {
+        Quaternion::Slerp(qa.data(), qb.data(), 0.3f, qr.data(), n);
+        Bench::Consume(qr[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, MaxError(Quaternion::Slerp(qa[i], qb[i], 0.3f), qr[i]));
+    }
+    bench.Verify("quaternion_slerp_batch", error, 1e-5);
+
+    // Matrix:
+    bench.MeasureBatches("matrix_multiply", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            mr[i] = ma[i] * mb[i];
+        }
+        Bench::Consume(mr[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        GLfloat reference[16];
+        ReferenceMultiply(ma[i].Get(), mb[i].Get(), reference);
+        for (int k = 0; k < 16; ++k) {
+            error = std::max(error, static_cast<double>(std::fabs(reference[k] - mr[i].Get()[k])));
+        }
+    }
+    bench.Verify("matrix_multiply", error, 1e-4);
+
+    bench.MeasureBatches("matrix_transform_point", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            pa[i] = ma[0] * pa[i];
+        }
+        Bench::Consume(pa[n - 1]);
+    });
+
+    // Trigonometry:
+    std::vector<GLfloat> sines(size), cosines(size);
+    bench.MeasureBatches("sincos", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            SinCos(angles[i], sines[i], cosines[i]);
+        }
+        Bench::Consume(sines[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, std::fabs(sines[i] - std::sin(static_cast<double>(angles[i]))));
+        error = std::max(error, std::fabs(cosines[i] - std::cos(static_cast<double>(angles[i]))));
+    }
+    bench.Verify("sincos", error, 1e-6);
+
+    // Flat scene, a frame without a new time must reuse every node, and a new time must only
+    // recompute the moving ones:
+    SphereObject sun(20.0, 24, 24, 0.0), earth(10.0, 24, 24, 60.0), moon(5.0, 24, 24, 25.0);
+    sun.AddChildren(&earth);
+    earth.AddChildren(&moon);
+    earth.SetOrbitMotion(AngularMotion(25.0));
+    earth.SetSpinMotion(AngularMotion(50.0));
+    moon.SetOrbitMotion(AngularMotion(100.0));
+    FlatScene scene;
+    scene.Compile(&sun);
+    scene.SetTime(1.0);
+    scene.Update();
+    scene.SetTime(1.0);
+    scene.Update();
+    bench.Verify("flat_scene_reuse_still", static_cast<double>(scene.GetRecomputed()), 0.0);
+    scene.SetTime(2.0);
+    scene.Update();
+    bench.Verify("flat_scene_recompute_moving", std::fabs(static_cast<double>(scene.GetRecomputed()) - 2.0), 0.0);
+
+    // Ephemeris, the orbits of the practice fitted over their common period:
+    const KeplerOrbit kepler[] = {
+        { 60.0, 0.2, 5.0, 0.0, 360.0 / 25.0, 0.0 },
+        { 25.0, 0.3, 15.0, 45.0, 360.0 / 100.0, 0.0 }
+    };
+    const GLdouble periods[] = { kepler[0].period, kepler[1].period };
+    Ephemeris ephemeris;
+    ephemeris.Fit(2, Ephemeris::CommonPeriod(periods, 2), 64, 10,
+        [&kepler] (size_t body, GLdouble seconds, GLfloat * position) {
+            kepler[body].Position(seconds, position);
+        });
+    std::vector<GLdouble> times(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        times[i] = bench.Random(-100.0f, 100.0f);
+    }
+    std::vector<GLfloat> positions(size * 2 * Ephemeris::LANES);
+    bench.MeasureBatches("ephemeris_evaluate", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            ephemeris.Evaluate(times[i], &positions[i * 2 * Ephemeris::LANES]);
+        }
+        Bench::Consume(positions[0]);
+    });
+    double model = 0.0, scalar = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        for (std::size_t b = 0; b < 2; ++b) {
+            GLfloat exact[3], reference[Ephemeris::LANES];
+            const GLfloat * fitted = &positions[(i * 2 + b) * Ephemeris::LANES];
+            kepler[b].Position(times[i], exact);
+            ephemeris.EvaluateScalar(b, times[i], reference);
+            for (int a = 0; a < 3; ++a) {
+                model = std::max(model, std::fabs(static_cast<double>(fitted[a]) - exact[a]));
+                scalar = std::max(scalar, std::fabs(static_cast<double>(fitted[a]) - reference[a]));
+            }
+        }
+    }
+    bench.Verify("ephemeris_kepler", model, 1e-3);
+    bench.Verify("ephemeris_scalar", scalar, 1e-4);
+
+    // Gravity, a batch is a whole step of that many bodies, so batches_per_second are the steps:
+    std::vector<unsigned int> threads;
+    threads.push_back(1);
+    threads.push_back(2);
+    threads.push_back(4);
+    unsigned int hardware = std::thread::hardware_concurrency();
+    if (hardware > 4) {
+        threads.push_back(hardware);
+    }
+    const std::size_t BODIES[] = { 1000, 10000, 100000 };
+    for (auto count : threads) {
+        ThreadPool pool(count);
+        for (auto bodies : BODIES) {
+            GravitySystem system;
+            MakeCloud(bench, system, bodies, 1e5f);
+            bench.Measure("gravity_step_threads_" + std::to_string(count), bodies, [&] (std::size_t) {
+                system.Step(0.01f, pool);
+                GLfloat position[3];
+                system.GetPosition(bodies - 1, position);
+                Bench::Consume(position);
+            });
+        }
+    }
+
+    // The tree against all the pairs (theta 0), in a cloud without a central mass:
+    ThreadPool pool(2);
+    GravitySystem tree, pairs;
+    MakeCloud(bench, tree, 4000, 0.0f);
+    for (std::size_t i = 0; i < tree.Size(); ++i) {
+        GLfloat position[3], velocity[3];
+        tree.GetPosition(i, position);
+        tree.GetVelocity(i, velocity);
+        pairs.Add(position, velocity, 1.0f / tree.Size());
+    }
+    pairs.SetTheta(0.0f);
+    double squares = 0.0, norms = 0.0;
+    for (std::size_t i = 0; i < tree.Size(); ++i) {
+        GLfloat approximate[3], exact[3];
+        tree.GetAcceleration(i, approximate, pool);
+        pairs.GetAcceleration(i, exact, pool);
+        for (int k = 0; k < 3; ++k) {
+            squares += (approximate[k] - exact[k]) * (approximate[k] - exact[k]);
+            norms += exact[k] * exact[k];
+        }
+    }
+    bench.Verify("gravity_barnes_hut", std::sqrt(squares / norms), 2e-2);
+
+    // The leapfrog keeps the energy over many orbits:
+    GravitySystem orbits;
+    MakeCloud(bench, orbits, 500, 1e5f);
+    orbits.ZeroMomentum();
+    double energy = orbits.Energy();
+    for (int i = 0; i < 1000; ++i) {
+        orbits.Step(0.01f, pool);
+    }
+    bench.Verify("gravity_leapfrog_energy", std::fabs((orbits.Energy() - energy) / energy), 1e-4);
+}
@@ -0,0 +1,211 @@
+/*****************************************************************************************************
+ Copyright (c) 2015 Gorka Surez Garca
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*****************************************************************************************************/
+
+#include "bench.h"
+#include "../../GC-P02/source/gmesh.h"
+#include <algorithm>
+
+//****************************************************************************************************
+// Practice 2: gmath & gmesh (Vector3D, Quaternion, Matrix, AffineMatrix, NewellNormal)
+//****************************************************************************************************
+
+static double MaxError(const Vector3D & lhs, const Vector3D & rhs) {
+    double error = std::fabs(lhs.X() - rhs.X());
+    error = std::max(error, static_cast<double>(std::fabs(lhs.Y() - rhs.Y())));
+    error = std::max(error, static_cast<double>(std::fabs(lhs.Z() - rhs.Z())));
+    return std::max(error, static_cast<double>(std::fabs(lhs.W() - rhs.W())));
+}
+
+static void ReferenceMultiply(const GLfloat * lhs, const GLfloat * rhs, GLfloat * result) {
+    // Column-major 4x4 product without SIMD:
+    for (int j = 0; j < 4; ++j) {
+        for (int i = 0; i < 4; ++i) {
+            GLfloat value = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                value += lhs[k * 4 + i] * rhs[j * 4 + k];
+            }
+            result[j * 4 + i] = value;
+        }
+    }
+}
+
+void RunPractice2(Bench & bench) {
+    bench.Project("GC-P02");
+    const std::size_t size = bench.MaxBatch();
+
+    std::vector<Vector3D> va(size), vb(size), vr(size), vs(size);
+    std::vector<Quaternion> qa(size), qb(size), qr(size);
+    std::vector<Matrix> ma(size), mb(size), mr(size);
+    std::vector<AffineMatrix> aa(size), ar(size);
+    std::vector<GLfloat> xs(size), ys(size), zs(size), xd(size), yd(size), zd(size);
+    std::vector<GLfloat> angles(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        va[i].Set(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10), 1.0f);
+        vb[i].Set(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10), 0.0f);
+        xs[i] = va[i].X(), ys[i] = va[i].Y(), zs[i] = va[i].Z();
+        qa[i] = Quaternion::FromAxisAngle(bench.Random(-180, 180), bench.Random(-1, 1), bench.Random(-1, 1), 1.0f);
+        qb[i] = Quaternion::FromAxisAngle(bench.Random(-180, 180), 1.0f, bench.Random(-1, 1), bench.Random(-1, 1));
+        ma[i].SetAsRotate(bench.Random(-180, 180), bench.Random(-1, 1), 1.0f, bench.Random(-1, 1));
+        ma[i].AddTranslate(bench.Random(-10, 10), bench.Random(-10, 10), bench.Random(-10, 10));
+        mb[i].SetAsScale(bench.Random(0.5f, 2), bench.Random(0.5f, 2), bench.Random(0.5f, 2));
+        mb[i].AddRotate(bench.Random(-180, 180), 0.0f, 0.0f, 1.0f);
+        aa[i] = AffineMatrix(ma[i] * mb[i]);
+        angles[i] = bench.Random(-100, 100);
+    }
+
+    // Vector3D:
+    bench.MeasureBatches("vector3d_add_scaled", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] = va[i] + vb[i] * 0.5f;
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+    bench.MeasureBatches("vector3d_cross_dot", [&] (std::size_t n) {
+        GLfloat sum = 0.0f;
+        for (std::size_t i = 0; i < n; ++i) {
+            sum += va[i].Cross(vb[i]).Dot(va[i]);
+        }
+        Bench::Consume(sum);
+    });
+    bench.MeasureBatches("vector3d_add_scaled_in_place", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i].AddScaled(vb[i], 1e-3f);
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+
+    // Quaternion:
+    bench.MeasureBatches("quaternion_multiply", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            qr[i] = qa[i] * qb[i];
+        }
+        Bench::Consume(qr[n - 1]);
+    });
+    bench.MeasureBatches("quaternion_rotate", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] = qa[i].Rotate(vb[i]);
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+
+    // Matrix:
+    bench.MeasureBatches("matrix_multiply", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            mr[i] = ma[i] * mb[i];
+        }
+        Bench::Consume(mr[n - 1]);
+    });
+    double error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        GLfloat reference[16];
+        ReferenceMultiply(ma[i].Data(), mb[i].Data(), reference);
+        for (int k = 0; k < 16; ++k) {
+            error = std::max(error, static_cast<double>(std::fabs(reference[k] - mr[i].Data()[k])));
+        }
+    }
+    bench.Verify("matrix_multiply", error, 1e-4);
+
+    bench.MeasureBatches("matrix_transform_scalar", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vs[i] = ma[0] * va[i];
+        }
+        Bench::Consume(vs[n - 1]);
+    });
+    bench.MeasureBatches("matrix_transform_batch", [&] (std::size_t n) {
+        ma[0].Transform(va.data(), vr.data(), n);
+        Bench::Consume(vr[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, MaxError(ma[0] * va[i], vr[i]));
+    }
+    bench.Verify("matrix_transform_batch", error, 1e-4);
+
+    bench.MeasureBatches("matrix_transform_soa", [&] (std::size_t n) {
+        ma[0].Transform(xs.data(), ys.data(), zs.data(), W_AS_POINT, xd.data(), yd.data(), zd.data(), n);
+        Bench::Consume(xd[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, MaxError(ma[0] * va[i], Vector3D(xd[i], yd[i], zd[i], W_AS_POINT)));
+    }
+    bench.Verify("matrix_transform_soa", error, 1e-4);
+
+    // AffineMatrix:
+    bench.MeasureBatches("affine_multiply", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            ar[i] = aa[i] * aa[0];
+        }
+        Bench::Consume(ar[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        GLfloat reference[16], result[16];
+        ReferenceMultiply(aa[i].ToMatrix().Data(), aa[0].ToMatrix().Data(), reference);
+        ar[i].ToColumnMajor(result);
+        for (int k = 0; k < 16; ++k) {
+            error = std::max(error, static_cast<double>(std::fabs(reference[k] - result[k])));
+        }
+    }
+    bench.Verify("affine_multiply", error, 1e-4);
+
+    bench.MeasureBatches("affine_inverse", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            ar[i] = aa[i].Inverse();
+        }
+        Bench::Consume(ar[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        // The inverse applied after the matrix must give back the same point:
+        error = std::max(error, MaxError(ar[i] * (aa[i] * va[i]), va[i]));
+    }
+    bench.Verify("affine_inverse", error, 1e-3);
+
+    // Newell normals of random quads:
+    const GLuint quad[] = { 0, 1, 2, 3 };
+    bench.MeasureBatches("newell_normal", [&] (std::size_t n) {
+        for (std::size_t i = 0; i + 4 <= n; i += 4) {
+            vr[i] = NewellNormal(&va[i], quad, 4);
+        }
+        Bench::Consume(vr[n - 4]);
+    });
+
+    // Trigonometry:
+    std::vector<GLfloat> sines(size), cosines(size), sinesBatch(size), cosinesBatch(size);
+    bench.MeasureBatches("sincos_scalar", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            SinCos(angles[i], sines[i], cosines[i]);
+        }
+        Bench::Consume(sines[n - 1]);
+    });
+    bench.MeasureBatches("sincos_batch", [&] (std::size_t n) {
+        SinCos(angles.data(), sinesBatch.data(), cosinesBatch.data(), n);
+        Bench::Consume(sinesBatch[n - 1]);
+    });
+    error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, static_cast<double>(std::fabs(sines[i] - sinesBatch[i])));
+        error = std::max(error, static_cast<double>(std::fabs(cosines[i] - cosinesBatch[i])));
+    }
+    bench.Verify("sincos_batch", error, 1e-6);
+}
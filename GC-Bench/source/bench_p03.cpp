@@ -0,0 +1,111 @@
+/*****************************************************************************************************
+ Copyright (c) 2015 Gorka Surez Garca
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*****************************************************************************************************/
+
+#include "bench.h"
+#include "../../GC-P03/source/gobject.hpp"
+#include <algorithm>
+
+//****************************************************************************************************
+// Practice 3: gmath & gobject (Vector2D, GraphicTriangle)
+//****************************************************************************************************
+
+static GLfloat EdgeSign(const Vector2D & a, const Vector2D & b, const Vector2D & p) {
+    return (b.X() - a.X()) * (p.Y() - a.Y()) - (b.Y() - a.Y()) * (p.X() - a.X());
+}
+
+void RunPractice3(Bench & bench) {
+    bench.Project("GC-P03");
+    const std::size_t size = bench.MaxBatch();
+
+    std::vector<Vector2D> va(size), vb(size), vr(size);
+    std::vector<GLfloat> angles(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        va[i].Set(bench.Random(-10, 10), bench.Random(-10, 10));
+        vb[i].Set(bench.Random(-10, 10), bench.Random(-10, 10));
+        angles[i] = bench.Random(-360, 360);
+    }
+
+    // Vector2D:
+    bench.MeasureBatches("vector2d_add_scaled", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] = va[i] + vb[i] * 0.5f;
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+    bench.MeasureBatches("vector2d_add_in_place", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] += vb[i];
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+    bench.MeasureBatches("vector2d_rotate", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] = va[i].Rotate(angles[i]);
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+    bench.MeasureBatches("vector2d_reflection", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            vr[i] = va[i].Reflection(vb[i]);
+        }
+        Bench::Consume(vr[n - 1]);
+    });
+
+    // Point in triangle:
+    Vector2D p1(-8.0f, -6.0f), p2(9.0f, -4.0f), p3(1.0f, 8.0f);
+    GraphicTriangle triangle(p1, p2, p3, Vector2D(0, 0), Vector2D(1, 0), Vector2D(0, 1));
+    std::vector<char> inside(size);
+    bench.MeasureBatches("triangle_inside", [&] (std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            inside[i] = triangle.Inside(va[i]);
+        }
+        Bench::Consume(inside[n - 1]);
+    });
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        GLfloat s1 = EdgeSign(p1, p2, va[i]), s2 = EdgeSign(p2, p3, va[i]), s3 = EdgeSign(p3, p1, va[i]);
+        // The points too close to an edge can go either way with rounding:
+        const GLfloat EPSILON = 1e-3f;
+        if (std::fabs(s1) < EPSILON || std::fabs(s2) < EPSILON || std::fabs(s3) < EPSILON) continue;
+        bool reference = (s1 > 0.0f && s2 > 0.0f && s3 > 0.0f) || (s1 < 0.0f && s2 < 0.0f && s3 < 0.0f);
+        if (reference != (inside[i] != 0)) {
+            ++mismatches;
+        }
+    }
+    bench.Verify("triangle_inside", static_cast<double>(mismatches), 0.0);
+
+    // Trigonometry:
+    std::vector<GLfloat> radians(size), sines(size), cosines(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        radians[i] = DegToRad(angles[i]);
+    }
+    bench.MeasureBatches("sincos_batch", [&] (std::size_t n) {
+        SinCos(radians.data(), sines.data(), cosines.data(), n);
+        Bench::Consume(sines[n - 1]);
+    });
+    double error = 0.0;
+    for (std::size_t i = 0; i < size; ++i) {
+        error = std::max(error, std::fabs(sines[i] - std::sin(static_cast<double>(radians[i]))));
+        error = std::max(error, std::fabs(cosines[i] - std::cos(static_cast<double>(radians[i]))));
+    }
+    bench.Verify("sincos_batch", error, 1e-6);
+}
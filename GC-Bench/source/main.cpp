@@ -0,0 +1,91 @@
+/*****************************************************************************************************
+ Copyright (c) 2015 Gorka Surez Garca
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*****************************************************************************************************/
+
+#include "bench.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//****************************************************************************************************
+// Data:
+//****************************************************************************************************
+
+volatile std::uint32_t Bench::Sink = 0;
+
+//****************************************************************************************************
+// Functions:
+//****************************************************************************************************
+
+void Bench::WriteJson(std::ostream & output) const {
+    output << "{\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results_.size(); ++i) {
+        auto & result = results_[i];
+        output << (i > 0 ? ",\n" : "\n") << "    { \"project\": \"" << result.project
+               << "\", \"name\": \"" << result.name << "\", \"batch\": " << result.batch
+               << ", \"repetitions\": " << result.repetitions
+               << ", \"ns_per_item\": " << result.nanosecondsPerItem
+               << ", \"items_per_second\": " << (1e9 / result.nanosecondsPerItem)
+               << ", \"batches_per_second\": " << (1e9 / (result.nanosecondsPerItem * result.batch)) << " }";
+    }
+    output << "\n  ],\n  \"checks\": [";
+    for (std::size_t i = 0; i < checks_.size(); ++i) {
+        auto & check = checks_[i];
+        output << (i > 0 ? ",\n" : "\n") << "    { \"project\": \"" << check.project
+               << "\", \"name\": \"" << check.name << "\", \"error\": " << check.error
+               << ", \"tolerance\": " << check.tolerance
+               << ", \"passed\": " << (check.passed ? "true" : "false") << " }";
+    }
+    output << "\n  ],\n  \"passed\": " << (Passed() ? "true" : "false") << "\n}\n";
+}
+
+//****************************************************************************************************
+// Main:
+//****************************************************************************************************
+
+int main(int argc, char ** argv) {
+    // Usage: bench [--quick] [--output file.json]
+    bool quick = false;
+    const char * path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--output file.json]" << std::endl;
+            return 2;
+        }
+    }
+
+    Bench bench(quick);
+    RunPractice1(bench);
+    RunPractice2(bench);
+    RunPractice3(bench);
+
+    if (path) {
+        std::ofstream file(path);
+        bench.WriteJson(file);
+    } else {
+        bench.WriteJson(std::cout);
+    }
+    return bench.Passed() ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+/*****************************************************************************************************
+ Copyright (c) 2015 Gorka Surez Garca
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*****************************************************************************************************/
+
+#ifndef __GTRIG_H__
+#define __GTRIG_H__
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <gl/GL.h>
+#include <cstddef>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GTRIG_SSE2
+#include <emmintrin.h>
+#endif
+
+//----------------------------------------------------------------------------------------------------
+// Trigonometry
+//----------------------------------------------------------------------------------------------------
+
+// SinCos computes both values of an angle in radians with a shared range reduction to [-PI/4, PI/4]
+// (Cody-Waite with the Cephes constants) and one minimax polynomial for each value. The max error
+// is ~1e-7 for |angle| < 1000 and it grows with the angle, so big angles should be wrapped first.
+// SinCosPrecise uses the standard library and it's also used by SinCos when GTRIG_PRECISE is defined.
+// This header is shared by all the practices, so there is only one copy of the polynomials.
+
+const GLfloat SINCOS_FOUR_OVER_PI = 1.27323954473516f;
+const GLfloat SINCOS_DP1 = 0.78515625f;
+const GLfloat SINCOS_DP2 = 2.4187564849853515625e-4f;
+const GLfloat SINCOS_DP3 = 3.77489497744594108e-8f;
+const GLfloat SINCOS_S1 = -1.9515295891e-4f, SINCOS_S2 = 8.3321608736e-3f, SINCOS_S3 = -1.6666654611e-1f;
+const GLfloat SINCOS_C1 = 2.443315711809948e-5f, SINCOS_C2 = -1.388731625493765e-3f, SINCOS_C3 = 4.166664568298827e-2f;
+
+inline void SinCosPrecise(GLfloat angle, GLfloat & sine, GLfloat & cosine) {
+    sine = std::sin(angle);
+    cosine = std::cos(angle);
+}
+
+inline void SinCos(GLfloat angle, GLfloat & sine, GLfloat & cosine) {
+#ifdef GTRIG_PRECISE
+    SinCosPrecise(angle, sine, cosine);
+#else
+    GLfloat x = std::fabs(angle);
+    int quadrant = (static_cast<int>(x * SINCOS_FOUR_OVER_PI) + 1) & ~1;
+    GLfloat y = static_cast<GLfloat>(quadrant);
+    x = ((x - y * SINCOS_DP1) - y * SINCOS_DP2) - y * SINCOS_DP3;
+    GLfloat z = x * x;
+    GLfloat s = ((SINCOS_S1 * z + SINCOS_S2) * z + SINCOS_S3) * z * x + x;
+    GLfloat c = ((SINCOS_C1 * z + SINCOS_C2) * z + SINCOS_C3) * z * z - 0.5f * z + 1.0f;
+    if (quadrant & 2) {
+        GLfloat swap = s; s = c; c = swap;
+    }
+    sine = (quadrant & 4) ? -s : s;
+    cosine = ((quadrant + 2) & 4) ? -c : c;
+    if (angle < 0.0f) sine = -sine;
+#endif
+}
+
+inline void SinCos(const GLfloat * angles, GLfloat * sines, GLfloat * cosines, std::size_t count) {
+    // Same as SinCos for each angle, four angles for each iteration with SSE2:
+    std::size_t i = 0;
+#if defined(GTRIG_SSE2) && !defined(GTRIG_PRECISE)
+    const __m128 signMask = _mm_set1_ps(-0.0f), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+    const __m128i int1 = _mm_set1_epi32(1), int2 = _mm_set1_epi32(2), int4 = _mm_set1_epi32(4);
+    for (; i + 4 <= count; i += 4) {
+        __m128 angle = _mm_loadu_ps(angles + i);
+        __m128 sign = _mm_and_ps(angle, signMask);
+        __m128 x = _mm_andnot_ps(signMask, angle);
+        __m128i quadrant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(SINCOS_FOUR_OVER_PI)));
+        quadrant = _mm_andnot_si128(int1, _mm_add_epi32(quadrant, int1));
+        __m128 y = _mm_cvtepi32_ps(quadrant);
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(SINCOS_DP1)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(SINCOS_DP2)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(SINCOS_DP3)));
+        __m128 z = _mm_mul_ps(x, x);
+        __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINCOS_S1), z), _mm_set1_ps(SINCOS_S2));
+        s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SINCOS_S3));
+        s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+        __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINCOS_C1), z), _mm_set1_ps(SINCOS_C2));
+        c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(SINCOS_C3));
+        c = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(half, z));
+        c = _mm_add_ps(c, one);
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, int2), int2));
+        __m128 vs = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        __m128 vc = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+        __m128 flipSine = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, int4), 29));
+        __m128 flipCosine = _mm_castsi128_ps(_mm_slli_epi32(
+            _mm_and_si128(_mm_add_epi32(quadrant, int2), int4), 29));
+        _mm_storeu_ps(sines + i, _mm_xor_ps(vs, _mm_xor_ps(flipSine, sign)));
+        _mm_storeu_ps(cosines + i, _mm_xor_ps(vc, flipCosine));
+    }
+#endif
+    for (; i < count; ++i) {
+        SinCos(angles[i], sines[i], cosines[i]);
+    }
+}
+
+#endif
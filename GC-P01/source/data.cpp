@@ -22,6 +22,7 @@
 
 #include "include.h"
 #include "gentity.h"
+#include "data.h"
 
 const GLdouble SUN_RADIUS   = 20.0, EARTH_RADIUS   = 10.0, MOON_RADIUS   =  5.0;
 const GLdouble SUN_DISTANCE =  0.0, EARTH_DISTANCE = 60.0, MOON_DISTANCE = 25.0, SATELLITE_DISTANCE = 15.0;
@@ -37,6 +38,12 @@ bool UseOrtho = true;
 bool UseOneVP = true;
 bool UseTimer = false;
 bool UseAxes  = true;
+bool UseStats = false;
+bool UseConstellation = false;
+bool UseBelt = false;
+bool UseStars = true;
+bool UseEphemeris = false;
+bool UseGravity = false;
 
 GLint WindowColumns = 4;
 GLint WindowRows    = 4;
@@ -49,6 +56,19 @@ SphereObject EarthSphere(EARTH_RADIUS, SPHERE_SLICES, SPHERE_STACKS, EARTH_DISTA
 SphereObject MoonSphere(MOON_RADIUS, SPHERE_SLICES, SPHERE_STACKS, MOON_DISTANCE);
 
 SatelliteObject HumanSatellite(SATELLITE_DISTANCE);
+ConstellationObject SatelliteSwarm(CONSTELLATION_MODEL_SIZE);
+BeltObject AsteroidBelt;
+
+StarField SkyStars;
+
+KeplerOrbit EarthKepler = {
+    EARTH_DISTANCE, EARTH_ECCENTRICITY, EARTH_INCLINATION, EARTH_PERIAPSIS, 360.0 / EARTH_ORBIT_SPEED, 0.0
+};
+KeplerOrbit MoonKepler = {
+    MOON_DISTANCE, MOON_ECCENTRICITY, MOON_INCLINATION, MOON_PERIAPSIS, 360.0 / MOON_ORBIT_SPEED, 0.0
+};
+Ephemeris SolarEphemeris;
+GravitySystem SolarGravity;
 
 CircleObject EarthOrbit(EARTH_DISTANCE, CIRCLE_SLICES, CIRCLE_LOOPS, 90.0f);
 CircleObject MoonOrbit(MOON_DISTANCE, CIRCLE_SLICES, CIRCLE_LOOPS, 90.0f);
@@ -56,6 +76,16 @@ CircleObject SatelliteOrbit(SATELLITE_DISTANCE, CIRCLE_SLICES, CIRCLE_LOOPS);
 
 AxesObject MainAxes;
 
+FlatScene SolarScene;
+CommandList AxesCommands;
+
+SimulationClock MainClock(TICK_RATE, MAX_CATCH_UP_STEPS);
+GLdouble PreviousTime = 0.0;
+GLdouble CurrentTime = 0.0;
+GLdouble TimeScale = 1.0;
+
+Matrix ProjectionMatrix;
+
 Texture EarthTexture;
 Texture MoonTexture;
 
@@ -34,6 +34,12 @@ extern bool UseOrtho;
 extern bool UseOneVP;
 extern bool UseTimer;
 extern bool UseAxes;
+extern bool UseStats;
+extern bool UseConstellation;
+extern bool UseBelt;
+extern bool UseStars;
+extern bool UseEphemeris;
+extern bool UseGravity;
 
 extern GLint WindowColumns;
 extern GLint WindowRows;
@@ -46,6 +52,15 @@ extern SphereObject EarthSphere;
 extern SphereObject MoonSphere;
 
 extern SatelliteObject HumanSatellite;
+extern ConstellationObject SatelliteSwarm;
+extern BeltObject AsteroidBelt;
+
+extern StarField SkyStars;
+
+extern KeplerOrbit EarthKepler;
+extern KeplerOrbit MoonKepler;
+extern Ephemeris SolarEphemeris;
+extern GravitySystem SolarGravity;
 
 extern CircleObject EarthOrbit;
 extern CircleObject MoonOrbit;
@@ -53,6 +68,16 @@ extern CircleObject SatelliteOrbit;
 
 extern AxesObject MainAxes;
 
+extern FlatScene SolarScene;
+extern CommandList AxesCommands;
+
+extern SimulationClock MainClock;
+extern GLdouble PreviousTime;
+extern GLdouble CurrentTime;
+extern GLdouble TimeScale;
+
+extern Matrix ProjectionMatrix;
+
 extern Texture EarthTexture;
 extern Texture MoonTexture;
 
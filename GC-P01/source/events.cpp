@@ -29,6 +29,7 @@
 //****************************************************************************************************
 
 void OnRender () {
+    UpdateSimulation();
     if (UseOneVP) {
         DrawScene();
     } else {
@@ -75,8 +76,42 @@ void OnKeyboard (unsigned char ascii, int mouseX, int mouseY) {
             repaint = false;
         } else {
             OneStepRotation();
+            ApplySimulationTime(1.0);
         }
         break;
+    case 'k':
+        UseStars = !UseStars;
+        break;
+    case 'e':
+        UseEphemeris = !UseEphemeris;
+        UpdateEphemeris();
+        ApplySimulationTime(1.0);
+        break;
+    case 'f':
+        UseGravity = !UseGravity;
+        UpdateGravity();
+        break;
+    case 'r':
+        ChangeTimeScale(-1.0);
+        break;
+    case '<':
+        ChangeTimeScale(0.5);
+        break;
+    case '>':
+        ChangeTimeScale(2.0);
+        break;
+    case ',':
+        JumpSimulationTime(-JUMP_SECONDS);
+        break;
+    case '.':
+        JumpSimulationTime(JUMP_SECONDS);
+        break;
+    case '[':
+        ChangeTickRate(0.5);
+        break;
+    case ']':
+        ChangeTickRate(2.0);
+        break;
     case 't':
         UseOneVP = !UseOneVP;
         OnResize(WindowWidth, WindowHeight);
@@ -156,13 +191,26 @@ void OnSpecial (int keyCode, int mouseX, int mouseY) {
     case GLUT_KEY_F5:
         ResetConfiguration();
         break;
+    case GLUT_KEY_F6:
+        UseConstellation = !UseConstellation;
+        UpdateConstellation();
+        break;
+    case GLUT_KEY_F10:
+        UseBelt = !UseBelt;
+        UpdateBelt();
+        if (UseGravity) UpdateGravity();
+        break;
+    case GLUT_KEY_F7:
+        UseStats = !UseStats;
+        break;
     case GLUT_KEY_F8:
         UseAxes = !UseAxes;
         break;
     case GLUT_KEY_F9:
         UseTimer = !UseTimer;
         if (UseTimer) {
-            glutTimerFunc(40, OnTimer, 0);
+            StartSimulation();
+            glutTimerFunc(FRAME_INTERVAL, OnTimer, 0);
         }
         break;
     case GLUT_KEY_UP:
@@ -209,9 +257,9 @@ void OnSpecial (int keyCode, int mouseX, int mouseY) {
 //----------------------------------------------------------------------------------------------------
 
 void OnTimer (int value) {
+    // The timer only paces the frames, the simulation advances with its own clock:
     if (UseTimer) {
-        OneStepRotation();
         glutPostRedisplay();
-        glutTimerFunc(40, OnTimer, 0);
+        glutTimerFunc(FRAME_INTERVAL, OnTimer, 0);
     }
 }
@@ -21,6 +21,7 @@
 *****************************************************************************************************/
 
 #include "gentity.h"
+#include <random>
 
 //====================================================================================================
 // class Camera:
@@ -29,44 +30,26 @@
 void Camera::moveN(GLfloat value) {
     Vector3 dir = look_ - eye_;
     dir.Normalize();
-    dir = dir * value;
-    eye_ = eye_ + dir;
-    look_ = look_ + dir;
+    eye_.AddScaled(dir, value);
+    look_.AddScaled(dir, value);
 }
 
 void Camera::moveU(GLfloat value) {
-    Vector3 dir1 = look_ - eye_;
-    Vector3 dir2 = up_;
-    dir1.Normalize();
-    dir2.Normalize();
-    Vector3 dir = dir2.Cross(dir1);
+    Vector3 dir = up_.Cross(look_ - eye_);
     dir.Normalize();
-    dir = dir * value;
-    eye_ = eye_ + dir;
-    look_ = look_ + dir;
+    eye_.AddScaled(dir, value);
+    look_.AddScaled(dir, value);
 }
 
 void Camera::moveV(GLfloat value) {
-    Vector3 dir = up_;
-    dir.Normalize();
-    dir = dir * value;
-    eye_ = eye_ + dir;
-    look_ = look_ + dir;
+    Vector3 dir = up_.Normalized();
+    eye_.AddScaled(dir, value);
+    look_.AddScaled(dir, value);
 }
 
 void Camera::rotate(GLfloat value) {
     Vector3 view = look_ - eye_;
-    value = DegToRad(value);
-    Quaternion temp(
-        up_.X() * std::sin(value * 0.5f),
-        up_.Y() * std::sin(value * 0.5f),
-        up_.Z() * std::sin(value * 0.5f),
-        std::cos(value * 0.5f)
-    );
-    Quaternion qview(view.X(), view.Y(), view.Z(), 0.0f);
-    Quaternion result = (temp * qview) * temp.Conjugate();
-    view.Set(result);
-    look_ = view + eye_;
+    look_ = Quaternion::FromAxisAngle(up_, value).Rotate(view) + eye_;
 }
 
 void Camera::SetEye(GLfloat x, GLfloat y, GLfloat z) {
@@ -81,12 +64,16 @@ void Camera::SetUp(GLfloat x, GLfloat y, GLfloat z) {
     up_.Set(x, y, z);
 }
 
+Matrix Camera::GetViewMatrix() const {
+    Matrix result;
+    result.SetAsLookAt(eye_, look_, up_);
+    return result;
+}
+
 void Camera::Apply() {
+    // The same matrix is used to build the frustum for the culling:
     glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    gluLookAt(eye_.X(), eye_.Y(), eye_.Z(),
-                look_.X(), look_.Y(), look_.Z(),
-                up_.X(), up_.Y(), up_.Z());
+    GetViewMatrix().LoadInOpenGL();
     glLightfv(GL_LIGHT1, GL_POSITION, Point3(eye_).Get());
 }
 
@@ -94,8 +81,10 @@ void Camera::Apply() {
 // class CircleObject:
 //====================================================================================================
 
+// Coarsest levels of detail of the circles and the spheres:
+static const GLint MIN_DETAIL_SLICES = 8, MIN_DETAIL_STACKS = 4;
+
 CircleObject::CircleObject(GLdouble radius, GLint slices, GLint loops, GLfloat xrotation) {
-    object_ = gluNewQuadric();
     radius_ = radius;
     slices_ = slices;
     loops_ = loops;
@@ -104,26 +93,37 @@ CircleObject::CircleObject(GLdouble radius, GLint slices, GLint loops, GLfloat x
 }
 
 CircleObject::~CircleObject() {
-    gluDeleteQuadric(object_);
 }
 
 void CircleObject::Initialize() {
-    gluQuadricDrawStyle(object_, GLU_LINE);
-    gluQuadricOrientation(object_, GLU_OUTSIDE);
-    gluQuadricNormals(object_, GLU_SMOOTH);
+    detail_.SetChain(slices_, MIN_DETAIL_SLICES);
+    for (int i = 0; i < detail_.Count(); ++i) {
+        levels_[i] = GeometryBuffer::Disk(radius_, detail_.Slices(i), loops_);
+    }
+    geometry_ = levels_[0];
 }
 
-void CircleObject::Draw() {
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-        glRotatef(xrotation_, 1.0f, 0.0f, 0.0f);
-        drawChildrens();
-        material_.Apply();
-        glLineWidth(2.0f);
-        glDisable(GL_LIGHTING);
-        gluDisk(object_, radius_, radius_, slices_, loops_);
-        glEnable(GL_LIGHTING);
-    glPopMatrix();
+void CircleObject::GetLocalMatrix(Matrix & victim) const {
+    victim.SetAsRotate(xrotation_, 1.0f, 0.0f, 0.0f);
+}
+
+GLfloat CircleObject::GetRadius() const {
+    return static_cast<GLfloat>(radius_);
+}
+
+NodeObject::Pass CircleObject::GetPass() const {
+    return UNLIT_PASS;
+}
+
+void CircleObject::SelectDetail(GLfloat pixels) {
+    geometry_ = levels_[detail_.Select(pixels)];
+}
+
+void CircleObject::DrawGeometry() {
+    material_.Apply();
+    GLState::LineWidth(2.0f);
+    GLState::Disable(GL_LIGHTING);
+    geometry_->Draw();
 }
 
 //====================================================================================================
@@ -131,7 +131,6 @@ void CircleObject::Draw() {
 //====================================================================================================
 
 SphereObject::SphereObject(GLdouble radius, GLint slices, GLint stacks, GLdouble distance) {
-    object_ = gluNewQuadric();
     radius_ = radius;
     slices_ = slices;
     stacks_ = stacks;
@@ -140,30 +139,54 @@ SphereObject::SphereObject(GLdouble radius, GLint slices, GLint stacks, GLdouble
 }
 
 SphereObject::~SphereObject() {
-    gluDeleteQuadric(object_);
 }
 
 void SphereObject::Initialize() {
     rotation_ = 0.0;
     orbitRotation_ = 0.0;
-    gluQuadricDrawStyle(object_, GLU_FILL);
-    gluQuadricOrientation(object_, GLU_OUTSIDE);
-    gluQuadricNormals(object_, GLU_SMOOTH);
-    gluQuadricTexture(object_, GL_TRUE);
+    usePosition_ = false;
+    SetDirty();
+    detail_.SetChain(slices_, MIN_DETAIL_SLICES);
+    for (int i = 0; i < detail_.Count(); ++i) {
+        GLint stacks = stacks_ * detail_.Slices(i) / slices_;
+        stacks = stacks > MIN_DETAIL_STACKS ? stacks : MIN_DETAIL_STACKS;
+        levels_[i] = GeometryBuffer::Sphere(radius_, detail_.Slices(i), stacks);
+    }
+    geometry_ = levels_[0];
 }
 
-void SphereObject::Draw() {
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-        glRotated(orbitRotation_, 0.0, 1.0, 0.0);
-        glTranslated(distance_, 0.0, 0.0);
-        glRotated(-orbitRotation_, 0.0, 1.0, 0.0);
-        drawChildrens();
-        glRotated(rotation_, 0.0, 1.0, 0.0);
-        glRotated(-90.0, 1.0, 0.0, 0.0);
-        material_.Apply();
-        gluSphere(object_, radius_, slices_, stacks_);
-    glPopMatrix();
+void SphereObject::GetLocalMatrix(Matrix & victim) const {
+    // A position from an ephemeris replaces the circular orbit:
+    if (usePosition_) {
+        victim.SetAsTranslate(position_[0], position_[1], position_[2]);
+        return;
+    }
+    // The orbit rotations cancel each other, so the childrens are only translated:
+    GLfloat sine, cosine, distance = static_cast<GLfloat>(distance_);
+    SinCos(DegToRad(static_cast<GLfloat>(orbitRotation_)), sine, cosine);
+    victim.SetAsTranslate(distance * cosine, 0.0f, -distance * sine);
+}
+
+GLfloat SphereObject::GetRadius() const {
+    return static_cast<GLfloat>(radius_);
+}
+
+void SphereObject::SelectDetail(GLfloat pixels) {
+    geometry_ = levels_[detail_.Select(pixels)];
+}
+
+void SphereObject::SetTime(GLdouble seconds) {
+    // The still motions are applied when they are set, so a still node is never dirty:
+    if (spinMotion_.GetRate() != 0.0) SetRotation(spinMotion_.At(seconds));
+    if (orbitMotion_.GetRate() != 0.0) SetOrbitRotation(orbitMotion_.At(seconds));
+}
+
+void SphereObject::DrawGeometry() {
+    glRotated(rotation_, 0.0, 1.0, 0.0);
+    glRotated(-90.0, 1.0, 0.0, 0.0);
+    material_.Apply();
+    GLState::Enable(GL_LIGHTING);
+    geometry_->Draw();
 }
 
 void SphereObject::SetRotation(GLdouble value) {
@@ -171,7 +194,11 @@ void SphereObject::SetRotation(GLdouble value) {
 }
 
 void SphereObject::SetOrbitRotation(GLdouble value) {
-    orbitRotation_ = std::fmod(value, 360.0);
+    // Only a new angle changes the local matrix:
+    GLdouble angle = std::fmod(value, 360.0);
+    if (angle == orbitRotation_) return;
+    orbitRotation_ = angle;
+    SetDirty();
 }
 
 void SphereObject::AddRotation(GLdouble value) {
@@ -182,11 +209,34 @@ void SphereObject::AddOrbitRotation(GLdouble value) {
     SetOrbitRotation(orbitRotation_ + value);
 }
 
+void SphereObject::SetSpinMotion(const AngularMotion & value) {
+    spinMotion_ = value;
+    SetRotation(value.At(0.0));
+}
+
+void SphereObject::SetOrbitMotion(const AngularMotion & value) {
+    orbitMotion_ = value;
+    SetOrbitRotation(value.At(0.0));
+}
+
+void SphereObject::SetPosition(const GLfloat * value) {
+    position_[0] = value[0];
+    position_[1] = value[1];
+    position_[2] = value[2];
+    usePosition_ = true;
+    SetDirty();
+}
+
+void SphereObject::ClearPosition() {
+    usePosition_ = false;
+    SetDirty();
+}
+
 //====================================================================================================
 // class SatelliteObject:
 //====================================================================================================
 
-static const GLfloat SATELLITE_VERTEX[] = {
+static constexpr GLfloat SATELLITE_VERTEX[] = {
     // GL_TRIANGLES 0..35 (12)
      0.0f,  0.0f,  0.0f,  1.0f,  1.0f, -1.0f, -1.0f,  1.0f, -1.0f,
      0.0f,  0.0f,  0.0f,  1.0f, -1.0f, -1.0f,  1.0f,  1.0f, -1.0f,
@@ -197,29 +247,58 @@ static const GLfloat SATELLITE_VERTEX[] = {
     // GL_TRIANGLE_STRIP 48..59 (4)
     -1.0f,  1.0f,  0.0f,  1.0f,  1.0f,  0.0f, -1.0f, -1.0f,  0.0f,  1.0f, -1.0f,  0.0f
 };
-static const GLfloat SATELLITE_NORMAL[] = {
-    // GL_TRIANGLES 0..35 (12)
-     0.0f,  1.0f,  1.0f,  0.0f,  1.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-     1.0f,  0.0f,  1.0f,  1.0f,  0.0f,  1.0f,  1.0f,  0.0f,  1.0f,
-     0.0f, -1.0f,  1.0f,  0.0f, -1.0f,  1.0f,  0.0f, -1.0f,  1.0f,
-    -1.0f,  0.0f,  1.0f, -1.0f,  0.0f,  1.0f, -1.0f,  0.0f,  1.0f,
-    // GL_TRIANGLE_STRIP 36..47 (4)
-     0.0f,  0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, -1.0f,
-    // GL_TRIANGLE_STRIP 48..59 (4)
-     0.0f,  0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, -1.0f
-};
-static const GLfloat SATELLITE_COLOR[] = {
-    // GL_TRIANGLES 0..35 (12)
-    0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f,
-    0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f,
-    0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f,
-    0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f,
-    // GL_TRIANGLE_STRIP 36..47 (4)
-    0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f, 0.4f,
-    // GL_TRIANGLE_STRIP 48..59 (4)
-    0.0f, 0.3f, 0.6f, 0.0f, 0.3f, 0.6f, 0.0f, 0.3f, 0.6f, 0.0f, 0.3f, 0.6f
+static const int SATELLITE_VERTICES = 20, SATELLITE_TRIANGLES = 12, SATELLITE_STRIP = 4;
+
+// The normals and the colors are filled at compile time from the vertices:
+template <int N>
+struct SatelliteArray {
+    GLfloat data[N];
 };
 
+static constexpr void SatelliteFaceNormal(SatelliteArray<SATELLITE_VERTICES * 3> & normals,
+    int first, int count) {
+    // Normal of the first triangle (scaled to a maximum component of 1, GL_NORMALIZE is enabled):
+    const GLfloat * v = SATELLITE_VERTEX + first * 3;
+    GLfloat ax = v[3] - v[0], ay = v[4] - v[1], az = v[5] - v[2];
+    GLfloat bx = v[6] - v[0], by = v[7] - v[1], bz = v[8] - v[2];
+    GLfloat n[3] = { ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx };
+    GLfloat max = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        GLfloat value = n[i] < 0.0f ? -n[i] : n[i];
+        max = value > max ? value : max;
+    }
+    for (int i = first; i < first + count; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            normals.data[i * 3 + j] = n[j] / max;
+        }
+    }
+}
+
+static constexpr SatelliteArray<SATELLITE_VERTICES * 3> SatelliteNormals() {
+    SatelliteArray<SATELLITE_VERTICES * 3> result {};
+    for (int i = 0; i < SATELLITE_TRIANGLES; i += 3) {
+        SatelliteFaceNormal(result, i, 3);
+    }
+    SatelliteFaceNormal(result, SATELLITE_TRIANGLES, SATELLITE_STRIP);
+    SatelliteFaceNormal(result, SATELLITE_TRIANGLES + SATELLITE_STRIP, SATELLITE_STRIP);
+    return result;
+}
+
+static constexpr SatelliteArray<SATELLITE_VERTICES * 3> SatelliteColors() {
+    // The body is gray and the solar panel (the last strip) is blue:
+    SatelliteArray<SATELLITE_VERTICES * 3> result {};
+    for (int i = 0; i < SATELLITE_VERTICES; ++i) {
+        bool panel = i >= SATELLITE_TRIANGLES + SATELLITE_STRIP;
+        result.data[i * 3] = panel ? 0.0f : 0.4f;
+        result.data[i * 3 + 1] = panel ? 0.3f : 0.4f;
+        result.data[i * 3 + 2] = panel ? 0.6f : 0.4f;
+    }
+    return result;
+}
+
+static constexpr SatelliteArray<SATELLITE_VERTICES * 3> SATELLITE_NORMAL = SatelliteNormals();
+static constexpr SatelliteArray<SATELLITE_VERTICES * 3> SATELLITE_COLOR = SatelliteColors();
+
 SatelliteObject::SatelliteObject(GLdouble distance) {
     distance_ = distance;
     Initialize();
@@ -231,25 +310,45 @@ SatelliteObject::~SatelliteObject() {
 void SatelliteObject::Initialize() {
     rotation_ = 0.0;
     orbitRotation_ = 0.0;
-    glVertexPointer(3, GL_FLOAT, 0, SATELLITE_VERTEX);
-    glNormalPointer(GL_FLOAT, 0, SATELLITE_NORMAL);
-    glColorPointer(3, GL_FLOAT, 0, SATELLITE_COLOR);
+    SetDirty();
 }
 
-void SatelliteObject::Draw() {
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-        glRotated(-90.0, 1.0, 0.0, 0.0);
-        glRotated(orbitRotation_, 0.0, 1.0, 0.0);
-        glTranslated(distance_, 0.0, 0.0);
-        glRotated(-orbitRotation_, 0.0, 1.0, 0.0);
-        glRotated(-90.0, 1.0, 0.0, 0.0);
-        glRotated(rotation_, 0.0, 1.0, 0.0);
-        material_.Apply();
-        drawSide();
-        glRotated(180.0, 0.0, 1.0, 0.0);
-        drawSide();
-    glPopMatrix();
+void SatelliteObject::GetLocalMatrix(Matrix & victim) const {
+    // The orbit is in the XY plane, and the orbit rotations cancel each other:
+    GLfloat sine, cosine, distance = static_cast<GLfloat>(distance_);
+    SinCos(DegToRad(static_cast<GLfloat>(orbitRotation_)), sine, cosine);
+    victim.SetAsRotate(-90.0f, 1.0f, 0.0f, 0.0f);
+    victim.AddTranslate(distance * cosine, 0.0f, -distance * sine);
+}
+
+GLfloat SatelliteObject::GetRadius() const {
+    // The corners of the body are at (+/-1, +/-1, -1):
+    return 1.7320508f;
+}
+
+void SatelliteObject::SetTime(GLdouble seconds) {
+    // The still motions are applied when they are set, so a still node is never dirty:
+    if (spinMotion_.GetRate() != 0.0) SetRotation(spinMotion_.At(seconds));
+    if (orbitMotion_.GetRate() != 0.0) SetOrbitRotation(orbitMotion_.At(seconds));
+}
+
+void SatelliteObject::DrawGeometry() {
+    glRotated(-90.0, 1.0, 0.0, 0.0);
+    glRotated(rotation_, 0.0, 1.0, 0.0);
+    material_.Apply();
+    GLState::Enable(GL_LIGHTING);
+    // The arrays are shared with the cached geometry, so they are set before each draw:
+    GLState::EnableClientState(GL_NORMAL_ARRAY);
+    GLState::EnableClientState(GL_COLOR_ARRAY);
+    GLState::DisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, SATELLITE_VERTEX);
+    glNormalPointer(GL_FLOAT, 0, SATELLITE_NORMAL.data);
+    glColorPointer(3, GL_FLOAT, 0, SATELLITE_COLOR.data);
+    drawSide();
+    glRotated(180.0, 0.0, 1.0, 0.0);
+    drawSide();
+    // The color array leaves its last color as the current one:
+    GLState::InvalidateColor();
 }
 
 void SatelliteObject::SetRotation(GLdouble value) {
@@ -257,7 +356,11 @@ void SatelliteObject::SetRotation(GLdouble value) {
 }
 
 void SatelliteObject::SetOrbitRotation(GLdouble value) {
-    orbitRotation_ = std::fmod(value, 360.0);
+    // Only a new angle changes the local matrix:
+    GLdouble angle = std::fmod(value, 360.0);
+    if (angle == orbitRotation_) return;
+    orbitRotation_ = angle;
+    SetDirty();
 }
 
 void SatelliteObject::AddRotation(GLdouble value) {
@@ -268,10 +371,20 @@ void SatelliteObject::AddOrbitRotation(GLdouble value) {
     SetOrbitRotation(orbitRotation_ + value);
 }
 
+void SatelliteObject::SetSpinMotion(const AngularMotion & value) {
+    spinMotion_ = value;
+    SetRotation(value.At(0.0));
+}
+
+void SatelliteObject::SetOrbitMotion(const AngularMotion & value) {
+    orbitMotion_ = value;
+    SetOrbitRotation(value.At(0.0));
+}
+
 void SatelliteObject::drawSide() {
-    glDrawArrays(GL_TRIANGLES, 0, 12);
-    glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-    glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
+    glDrawArrays(GL_TRIANGLES, 0, SATELLITE_TRIANGLES);
+    glDrawArrays(GL_TRIANGLE_STRIP, SATELLITE_TRIANGLES, SATELLITE_STRIP);
+    glDrawArrays(GL_TRIANGLE_STRIP, SATELLITE_TRIANGLES + SATELLITE_STRIP, SATELLITE_STRIP);
     /*
     glColor3f(0.4f, 0.4f, 0.4f);
     glBegin(GL_TRIANGLES);
@@ -313,6 +426,447 @@ void SatelliteObject::drawSide() {
     //*/
 }
 
+//====================================================================================================
+// class ConstellationObject:
+//====================================================================================================
+
+const int ConstellationObject::MODEL_VERTICES;
+const int ConstellationObject::TRANSFORM_LENGTH;
+
+// The model of SatelliteObject as a list of triangles, with both sides and the rotation of its draw:
+struct ConstellationModel {
+    GLfloat vertex[ConstellationObject::MODEL_VERTICES * 3];
+    GLfloat normal[ConstellationObject::MODEL_VERTICES * 3];
+    GLfloat color[ConstellationObject::MODEL_VERTICES * 3];
+
+    ConstellationModel() {
+        // The strips are split in two triangles with the same winding:
+        int order[SATELLITE_TRIANGLES + 12], count = 0;
+        for (int i = 0; i < SATELLITE_TRIANGLES; ++i) {
+            order[count++] = i;
+        }
+        for (int first = SATELLITE_TRIANGLES; first < SATELLITE_VERTICES; first += SATELLITE_STRIP) {
+            const int strip[] = { 0, 1, 2, 2, 1, 3 };
+            for (int j = 0; j < 6; ++j) {
+                order[count++] = first + strip[j];
+            }
+        }
+        // The second side is rotated 180 degrees around Y, and then Rx(-90) is applied to both:
+        for (int side = 0, k = 0; side < 2; ++side) {
+            GLfloat sign = side ? -1.0f : 1.0f;
+            for (int i = 0; i < count; ++i, ++k) {
+                const GLfloat * v = SATELLITE_VERTEX + order[i] * 3;
+                const GLfloat * n = SATELLITE_NORMAL.data + order[i] * 3;
+                const GLfloat * c = SATELLITE_COLOR.data + order[i] * 3;
+                vertex[k * 3] = sign * v[0], vertex[k * 3 + 1] = sign * v[2], vertex[k * 3 + 2] = -v[1];
+                normal[k * 3] = sign * n[0], normal[k * 3 + 1] = sign * n[2], normal[k * 3 + 2] = -n[1];
+                color[k * 3] = c[0], color[k * 3 + 1] = c[1], color[k * 3 + 2] = c[2];
+            }
+        }
+    }
+};
+
+static const ConstellationModel & GetConstellationModel() {
+    static const ConstellationModel instance;
+    return instance;
+}
+
+ConstellationObject::ConstellationObject(GLfloat size) : size_(size), maxRadius_(0.0f) {
+    Initialize();
+}
+
+ConstellationObject::~ConstellationObject() {
+}
+
+void ConstellationObject::Initialize() {
+    radii_.clear();
+    phases_.clear();
+    rates_.clear();
+    inclinations_.clear();
+    spins_.clear();
+    transforms_.clear();
+    vertices_.clear();
+    normals_.clear();
+    colors_.clear();
+    maxRadius_ = 0.0f;
+    SetDirty();
+}
+
+GLfloat ConstellationObject::GetRadius() const {
+    // The corners of the model are at a distance of sqrt(3) from its origin:
+    return radii_.empty() ? 0.0f : maxRadius_ + size_ * 1.7320508f;
+}
+
+void ConstellationObject::SetTime(GLdouble seconds) {
+    ThreadPool::Shared().ParallelFor(radii_.size(), 256, [&] (size_t begin, size_t end) {
+        computeTransforms(begin, end, seconds);
+        transformModels(begin, end);
+    });
+}
+
+void ConstellationObject::DrawGeometry() {
+    if (radii_.empty()) return;
+    material_.Apply();
+    GLState::Enable(GL_LIGHTING);
+    GLState::EnableClientState(GL_NORMAL_ARRAY);
+    GLState::EnableClientState(GL_COLOR_ARRAY);
+    GLState::DisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, vertices_.data());
+    glNormalPointer(GL_FLOAT, 0, normals_.data());
+    glColorPointer(3, GL_FLOAT, 0, colors_.data());
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(radii_.size() * MODEL_VERTICES));
+    // The color array leaves its last color as the current one:
+    GLState::InvalidateColor();
+}
+
+void ConstellationObject::Add(GLfloat radius, GLfloat phase, GLfloat rate, GLfloat inclination, GLfloat spin) {
+    radii_.push_back(radius);
+    phases_.push_back(phase);
+    rates_.push_back(rate);
+    inclinations_.push_back(inclination);
+    spins_.push_back(spin);
+    maxRadius_ = radius > maxRadius_ ? radius : maxRadius_;
+
+    // The colors don't change, so they are copied once:
+    size_t size = radii_.size();
+    const ConstellationModel & model = GetConstellationModel();
+    transforms_.resize(size * TRANSFORM_LENGTH);
+    vertices_.resize(size * MODEL_VERTICES * 3);
+    normals_.resize(size * MODEL_VERTICES * 3);
+    colors_.insert(colors_.end(), std::begin(model.color), std::end(model.color));
+    SetDirty();
+}
+
+void ConstellationObject::Generate(size_t count, GLfloat minRadius, GLfloat maxRadius, GLfloat rate,
+    unsigned int seed) {
+    // The orbits follow Kepler's third law, the rate is given for the minimum radius:
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<GLfloat> radius(minRadius, maxRadius), angle(0.0f, 360.0f);
+    std::uniform_real_distribution<GLfloat> inclination(-60.0f, 60.0f), spin(-90.0f, 90.0f);
+    Initialize();
+    for (size_t i = 0; i < count; ++i) {
+        GLfloat r = radius(random), ratio = minRadius / r;
+        Add(r, angle(random), rate * ratio * std::sqrt(ratio), inclination(random), spin(random));
+    }
+}
+
+void ConstellationObject::computeTransforms(size_t begin, size_t end, GLdouble seconds) {
+    // Transform = Rx(inclination) * T(orbit) * Ry(spin) * S(size), as three columns and a translation:
+    for (size_t i = begin; i < end; ++i) {
+        GLfloat orbit = static_cast<GLfloat>(std::fmod(phases_[i] + rates_[i] * seconds, 360.0));
+        GLfloat spin = static_cast<GLfloat>(std::fmod(spins_[i] * seconds, 360.0));
+        GLfloat so, co, ss, cs, si, ci;
+        SinCos(DegToRad(orbit), so, co);
+        SinCos(DegToRad(spin), ss, cs);
+        SinCos(DegToRad(inclinations_[i]), si, ci);
+        GLfloat r = radii_[i], s = size_;
+        GLfloat * m = &transforms_[i * TRANSFORM_LENGTH];
+        m[0]  = cs * s,  m[1]  = ss * si * s,  m[2]  = -ss * ci * s, m[3]  = 0.0f;
+        m[4]  = 0.0f,    m[5]  = ci * s,       m[6]  = si * s,       m[7]  = 0.0f;
+        m[8]  = ss * s,  m[9]  = -cs * si * s, m[10] = cs * ci * s,  m[11] = 0.0f;
+        m[12] = r * co,  m[13] = r * so * si,  m[14] = -r * so * ci, m[15] = 1.0f;
+    }
+}
+
+void ConstellationObject::transformModels(size_t begin, size_t end) {
+    const ConstellationModel & model = GetConstellationModel();
+    for (size_t i = begin; i < end; ++i) {
+        const GLfloat * m = &transforms_[i * TRANSFORM_LENGTH];
+        GLfloat * vertex = &vertices_[i * MODEL_VERTICES * 3];
+        GLfloat * normal = &normals_[i * MODEL_VERTICES * 3];
+#ifdef GSYSTEM_SSE
+        // Each vertex is written with 4 floats and the last one is overwritten by the next vertex,
+        // but the last vertex is written with 3 floats, because the next model can be in other thread:
+        __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8);
+        __m128 c3 = _mm_loadu_ps(m + 12);
+        for (int j = 0; j < MODEL_VERTICES * 3; j += 3) {
+            const GLfloat * v = model.vertex + j, * n = model.normal + j;
+            __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v[0])),
+                _mm_mul_ps(c1, _mm_set1_ps(v[1]))), _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v[2])), c3));
+            __m128 q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n[0])),
+                _mm_mul_ps(c1, _mm_set1_ps(n[1]))), _mm_mul_ps(c2, _mm_set1_ps(n[2])));
+            if (j + 3 < MODEL_VERTICES * 3) {
+                _mm_storeu_ps(vertex + j, p);
+                _mm_storeu_ps(normal + j, q);
+            } else {
+                _mm_storel_pi(reinterpret_cast<__m64 *>(vertex + j), p);
+                _mm_store_ss(vertex + j + 2, _mm_movehl_ps(p, p));
+                _mm_storel_pi(reinterpret_cast<__m64 *>(normal + j), q);
+                _mm_store_ss(normal + j + 2, _mm_movehl_ps(q, q));
+            }
+        }
+#else
+        for (int j = 0; j < MODEL_VERTICES * 3; j += 3) {
+            const GLfloat * v = model.vertex + j, * n = model.normal + j;
+            for (int k = 0; k < 3; ++k) {
+                vertex[j + k] = m[k] * v[0] + m[4 + k] * v[1] + m[8 + k] * v[2] + m[12 + k];
+                normal[j + k] = m[k] * n[0] + m[4 + k] * n[1] + m[8 + k] * n[2];
+            }
+        }
+#endif
+    }
+}
+
+//====================================================================================================
+// class BeltObject:
+//====================================================================================================
+
+const int BeltObject::ROCK_MESHES;
+const int BeltObject::ROCK_VERTICES;
+const GLfloat BeltObject::POINT_PIXELS = 1.0f;
+
+static const GLfloat ROCK_MIN_SIZE = 0.3f, ROCK_MAX_SIZE = 1.2f;
+
+// Icosahedrons with the vertices moved in or out at random, as lists of triangles with flat normals:
+struct BeltRocks {
+    GLfloat vertex[BeltObject::ROCK_MESHES][BeltObject::ROCK_VERTICES * 3];
+    GLfloat normal[BeltObject::ROCK_MESHES][BeltObject::ROCK_VERTICES * 3];
+
+    BeltRocks() {
+        const GLfloat A = 0.525731112f, B = 0.850650808f;
+        const GLfloat ICOSAHEDRON[12][3] = {
+            { -A, 0.0f,  B }, {  A, 0.0f,  B }, { -A, 0.0f, -B }, {  A, 0.0f, -B },
+            { 0.0f,  B,  A }, { 0.0f,  B, -A }, { 0.0f, -B,  A }, { 0.0f, -B, -A },
+            {  B,  A, 0.0f }, { -B,  A, 0.0f }, {  B, -A, 0.0f }, { -B, -A, 0.0f }
+        };
+        const int FACES[20][3] = {
+            { 0, 4, 1 }, { 0, 9, 4 }, { 9, 5, 4 }, { 4, 5, 8 }, { 4, 8, 1 },
+            { 8, 10, 1 }, { 8, 3, 10 }, { 5, 3, 8 }, { 5, 2, 3 }, { 2, 7, 3 },
+            { 7, 10, 3 }, { 7, 6, 10 }, { 7, 11, 6 }, { 11, 0, 6 }, { 0, 1, 6 },
+            { 6, 1, 10 }, { 9, 0, 11 }, { 9, 11, 2 }, { 9, 2, 5 }, { 7, 2, 11 }
+        };
+        std::mt19937 random(BeltObject::ROCK_MESHES);
+        std::uniform_real_distribution<GLfloat> scale(0.7f, 1.0f);
+        for (int m = 0; m < BeltObject::ROCK_MESHES; ++m) {
+            GLfloat corner[12][3];
+            for (int i = 0; i < 12; ++i) {
+                GLfloat k = scale(random);
+                for (int j = 0; j < 3; ++j) {
+                    corner[i][j] = ICOSAHEDRON[i][j] * k;
+                }
+            }
+            // The faces are counterclockwise seen from outside:
+            for (int f = 0; f < 20; ++f) {
+                const GLfloat * a = corner[FACES[f][0]], * b = corner[FACES[f][2]], * c = corner[FACES[f][1]];
+                GLfloat u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                GLfloat v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                GLfloat n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+                const GLfloat * points[] = { a, b, c };
+                for (int k = 0; k < 3; ++k) {
+                    for (int j = 0; j < 3; ++j) {
+                        vertex[m][(f * 3 + k) * 3 + j] = points[k][j];
+                        normal[m][(f * 3 + k) * 3 + j] = n[j];
+                    }
+                }
+            }
+        }
+    }
+};
+
+static const BeltRocks & GetBeltRocks() {
+    static const BeltRocks instance;
+    return instance;
+}
+
+BeltObject::BeltObject() {
+    Initialize();
+}
+
+BeltObject::~BeltObject() {
+}
+
+void BeltObject::Initialize() {
+    radii_.clear();
+    phases_.clear();
+    rates_.clear();
+    heights_.clear();
+    spins_.clear();
+    sizes_.clear();
+    meshes_.clear();
+    xs_.clear();
+    zs_.clear();
+    angles_.clear();
+    classes_.clear();
+    rocks_.clear();
+    points_.clear();
+    maxRadius_ = 0.0f;
+    maxHeight_ = 0.0f;
+    maxSize_ = 0.0f;
+    culled_ = 0;
+    kinematic_ = true;
+    SetDirty();
+}
+
+GLfloat BeltObject::GetRadius() const {
+    if (radii_.empty()) return 0.0f;
+    return std::sqrt(maxRadius_ * maxRadius_ + maxHeight_ * maxHeight_) + maxSize_;
+}
+
+void BeltObject::PrepareView(const SceneView & view, const Matrix & world) {
+    // Classify the bodies in parallel, and then make the lists of rocks and points:
+    ThreadPool & pool = ThreadPool::Shared();
+    pool.ParallelFor(radii_.size(), 1024, [&] (size_t begin, size_t end) {
+        classify(begin, end, view, world);
+    });
+    rocks_.clear();
+    points_.clear();
+    culled_ = 0;
+    for (size_t i = 0, size = radii_.size(); i < size; ++i) {
+        if (classes_[i] == CULLED_BODY) {
+            ++culled_;
+        } else if (classes_[i] == POINT_BODY) {
+            points_.push_back(xs_[i]);
+            points_.push_back(heights_[i]);
+            points_.push_back(zs_[i]);
+        } else {
+            rocks_.push_back(static_cast<GLuint>(i));
+        }
+    }
+    rockVertices_.resize(rocks_.size() * ROCK_VERTICES * 3);
+    rockNormals_.resize(rocks_.size() * ROCK_VERTICES * 3);
+    pool.ParallelFor(rocks_.size(), 64, [&] (size_t begin, size_t end) {
+        transformRocks(begin, end);
+    });
+}
+
+void BeltObject::SetTime(GLdouble seconds) {
+    ThreadPool::Shared().ParallelFor(radii_.size(), 1024, [&] (size_t begin, size_t end) {
+        computePositions(begin, end, seconds);
+    });
+}
+
+void BeltObject::DrawGeometry() {
+    material_.Apply();
+    GLState::DisableClientState(GL_COLOR_ARRAY);
+    GLState::DisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (!rocks_.empty()) {
+        GLState::Enable(GL_LIGHTING);
+        GLState::EnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, rockVertices_.data());
+        glNormalPointer(GL_FLOAT, 0, rockNormals_.data());
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(rocks_.size() * ROCK_VERTICES));
+    }
+    if (!points_.empty()) {
+        GLState::Disable(GL_LIGHTING);
+        GLState::PointSize(1.0f);
+        GLState::DisableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, points_.data());
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(points_.size() / 3));
+    }
+}
+
+void BeltObject::Add(GLfloat radius, GLfloat phase, GLfloat rate, GLfloat height, GLfloat spin,
+    GLfloat size, unsigned char mesh) {
+    radii_.push_back(radius);
+    phases_.push_back(phase);
+    rates_.push_back(rate);
+    heights_.push_back(height);
+    spins_.push_back(spin);
+    sizes_.push_back(size);
+    meshes_.push_back(mesh % ROCK_MESHES);
+    xs_.push_back(radius);
+    zs_.push_back(0.0f);
+    angles_.push_back(0.0f);
+    classes_.push_back(CULLED_BODY);
+    GLfloat height2 = height < 0.0f ? -height : height;
+    maxRadius_ = radius > maxRadius_ ? radius : maxRadius_;
+    maxHeight_ = height2 > maxHeight_ ? height2 : maxHeight_;
+    maxSize_ = size > maxSize_ ? size : maxSize_;
+    SetDirty();
+}
+
+void BeltObject::Generate(size_t count, GLfloat minRadius, GLfloat maxRadius, GLfloat thickness,
+    GLfloat rate, unsigned int seed) {
+    // The orbits follow Kepler's third law, the rate is given for the minimum radius:
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<GLfloat> radius(minRadius, maxRadius), angle(0.0f, 360.0f);
+    std::uniform_real_distribution<GLfloat> height(-thickness, thickness), spin(-180.0f, 180.0f);
+    std::uniform_real_distribution<GLfloat> size(ROCK_MIN_SIZE, ROCK_MAX_SIZE);
+    Initialize();
+    radii_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        GLfloat r = radius(random), ratio = minRadius / r;
+        Add(r, angle(random), rate * ratio * std::sqrt(ratio), height(random), spin(random), size(random),
+            static_cast<unsigned char>(random() % ROCK_MESHES));
+    }
+}
+
+void BeltObject::GetPosition(size_t index, GLfloat * position) const {
+    position[0] = xs_[index];
+    position[1] = heights_[index];
+    position[2] = zs_[index];
+}
+
+void BeltObject::SetPosition(size_t index, const GLfloat * position) {
+    // The bounds only grow, so the belt isn't culled when a body goes away from it:
+    GLfloat radius = std::sqrt(position[0] * position[0] + position[2] * position[2]);
+    GLfloat height = position[1] < 0.0f ? -position[1] : position[1];
+    xs_[index] = position[0];
+    heights_[index] = position[1];
+    zs_[index] = position[2];
+    // A grown bound changes the bounding sphere, so the cached world bounds must be rebuilt:
+    if (radius > maxRadius_ || height > maxHeight_) {
+        maxRadius_ = radius > maxRadius_ ? radius : maxRadius_;
+        maxHeight_ = height > maxHeight_ ? height : maxHeight_;
+        SetDirty();
+    }
+}
+
+void BeltObject::SetKinematic(bool value) {
+    // When it isn't kinematic, the positions are given with SetPosition and the time only spins the rocks:
+    kinematic_ = value;
+}
+
+void BeltObject::computePositions(size_t begin, size_t end, GLdouble seconds) {
+    for (size_t i = begin; i < end; ++i) {
+        if (kinematic_) {
+            GLfloat orbit = static_cast<GLfloat>(std::fmod(phases_[i] + rates_[i] * seconds, 360.0));
+            GLfloat sine, cosine;
+            SinCos(DegToRad(orbit), sine, cosine);
+            xs_[i] = radii_[i] * cosine;
+            zs_[i] = -radii_[i] * sine;
+        }
+        angles_[i] = static_cast<GLfloat>(std::fmod(spins_[i] * seconds, 360.0));
+    }
+}
+
+void BeltObject::classify(size_t begin, size_t end, const SceneView & view, const Matrix & world) {
+    // The world matrix of the belt is a rigid transform, so the sizes don't change:
+    const Frustum & frustum = view.GetFrustum();
+    for (size_t i = begin; i < end; ++i) {
+        Point3 center = world * Point3(xs_[i], heights_[i], zs_[i]);
+        if (frustum.Test(center, sizes_[i]) == Frustum::OUTSIDE) {
+            classes_[i] = CULLED_BODY;
+        } else if (view.ScreenRadius(center, sizes_[i]) < POINT_PIXELS) {
+            classes_[i] = POINT_BODY;
+        } else {
+            classes_[i] = ROCK_BODY;
+        }
+    }
+}
+
+void BeltObject::transformRocks(size_t begin, size_t end) {
+    // Transform = T(position) * Ry(spin) * S(size):
+    const BeltRocks & model = GetBeltRocks();
+    for (size_t r = begin; r < end; ++r) {
+        size_t i = rocks_[r];
+        GLfloat sine, cosine, size = sizes_[i];
+        SinCos(DegToRad(angles_[i]), sine, cosine);
+        GLfloat x = xs_[i], y = heights_[i], z = zs_[i];
+        const GLfloat * v = model.vertex[meshes_[i]], * n = model.normal[meshes_[i]];
+        GLfloat * vertex = &rockVertices_[r * ROCK_VERTICES * 3];
+        GLfloat * normal = &rockNormals_[r * ROCK_VERTICES * 3];
+        for (int j = 0; j < ROCK_VERTICES * 3; j += 3) {
+            vertex[j]     = (cosine * v[j] + sine * v[j + 2]) * size + x;
+            vertex[j + 1] = v[j + 1] * size + y;
+            vertex[j + 2] = (cosine * v[j + 2] - sine * v[j]) * size + z;
+            normal[j]     = cosine * n[j] + sine * n[j + 2];
+            normal[j + 1] = n[j + 1];
+            normal[j + 2] = cosine * n[j + 2] - sine * n[j];
+        }
+    }
+}
+
 //====================================================================================================
 // class SatelliteObject:
 //====================================================================================================
@@ -325,26 +879,27 @@ AxesObject::~AxesObject() {}
 
 void AxesObject::Initialize() {}
 
-void AxesObject::Draw() {
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-        material_.Apply();
-        glDisable(GL_LIGHTING);
-        glLineWidth(2.0f);
-        glBegin(GL_LINES);
-            // Red X-axis:
-            glColor3f(1.0f, 0.0f, 0.0f);
-            glVertex3f(0.0f, 0.0f, 0.0f);
-            glVertex3f(AXIS_LEN, 0.0f, 0.0f);
-            // Green Y-axis:
-            glColor3f(0.0f, 1.0f, 0.0f);
-            glVertex3f(0.0f, 0.0f, 0.0f);
-            glVertex3f(0.0f, AXIS_LEN, 0.0f);
-            // Blue Z-axis:
-            glColor3f(0.0f, 0.0f, 1.0f);
-            glVertex3f(0.0f, 0.0f, 0.0f);
-            glVertex3f(0.0f, 0.0f, AXIS_LEN);
-        glEnd();
-        glEnable(GL_LIGHTING);
-    glPopMatrix();
+NodeObject::Pass AxesObject::GetPass() const {
+    return UNLIT_PASS;
+}
+
+void AxesObject::DrawGeometry() {
+    material_.Apply();
+    GLState::Disable(GL_LIGHTING);
+    GLState::LineWidth(2.0f);
+    glBegin(GL_LINES);
+        // Red X-axis:
+        glColor3f(1.0f, 0.0f, 0.0f);
+        glVertex3f(0.0f, 0.0f, 0.0f);
+        glVertex3f(AXIS_LEN, 0.0f, 0.0f);
+        // Green Y-axis:
+        glColor3f(0.0f, 1.0f, 0.0f);
+        glVertex3f(0.0f, 0.0f, 0.0f);
+        glVertex3f(0.0f, AXIS_LEN, 0.0f);
+        // Blue Z-axis:
+        glColor3f(0.0f, 0.0f, 1.0f);
+        glVertex3f(0.0f, 0.0f, 0.0f);
+        glVertex3f(0.0f, 0.0f, AXIS_LEN);
+    glEnd();
+    GLState::InvalidateColor();
 }
@@ -42,6 +42,7 @@ public:
     void SetEye(GLfloat x, GLfloat y, GLfloat z);
     void SetLook(GLfloat x, GLfloat y, GLfloat z);
     void SetUp(GLfloat x, GLfloat y, GLfloat z);
+    Matrix GetViewMatrix() const;
     void Apply();
     inline void MoveForward(GLfloat value) { moveN( value); }
     inline void MoveBackward(GLfloat value) { moveN(-value); }
@@ -59,7 +60,9 @@ public:
 
 class CircleObject : public NodeObject {
 protected:
-    GLUquadricObj * object_;
+    std::shared_ptr<const GeometryBuffer> geometry_;
+    std::shared_ptr<const GeometryBuffer> levels_[LevelOfDetail::MAX_LEVELS];
+    LevelOfDetail detail_;
     GLdouble radius_;
     GLint slices_;
     GLint loops_;
@@ -68,7 +71,11 @@ public:
     CircleObject(GLdouble radius, GLint slices, GLint loops, GLfloat xrotation = 0.0f);
     virtual ~CircleObject();
     virtual void Initialize();
-    virtual void Draw();
+    virtual void GetLocalMatrix(Matrix & victim) const;
+    virtual GLfloat GetRadius() const;
+    virtual Pass GetPass() const;
+    virtual void SelectDetail(GLfloat pixels);
+    virtual void DrawGeometry();
 };
 
 //----------------------------------------------------------------------------------------------------
@@ -77,22 +84,36 @@ public:
 
 class SphereObject : public NodeObject {
 private:
-    GLUquadricObj * object_;
+    std::shared_ptr<const GeometryBuffer> geometry_;
+    std::shared_ptr<const GeometryBuffer> levels_[LevelOfDetail::MAX_LEVELS];
+    LevelOfDetail detail_;
     GLdouble radius_;
     GLint slices_;
     GLint stacks_;
     GLdouble distance_;
     GLdouble rotation_;
     GLdouble orbitRotation_;
+    AngularMotion spinMotion_;
+    AngularMotion orbitMotion_;
+    GLfloat position_[3];
+    bool usePosition_;
 public:
     SphereObject(GLdouble radius, GLint slices, GLint stacks, GLdouble distance);
     virtual ~SphereObject();
     virtual void Initialize();
-    virtual void Draw();
+    virtual void GetLocalMatrix(Matrix & victim) const;
+    virtual GLfloat GetRadius() const;
+    virtual void SelectDetail(GLfloat pixels);
+    virtual void SetTime(GLdouble seconds);
+    virtual void DrawGeometry();
     void SetRotation(GLdouble value);
     void SetOrbitRotation(GLdouble value);
     void AddRotation(GLdouble value);
     void AddOrbitRotation(GLdouble value);
+    void SetSpinMotion(const AngularMotion & value);
+    void SetOrbitMotion(const AngularMotion & value);
+    void SetPosition(const GLfloat * value);
+    void ClearPosition();
 };
 
 //----------------------------------------------------------------------------------------------------
@@ -104,16 +125,125 @@ private:
     GLdouble distance_;
     GLdouble rotation_;
     GLdouble orbitRotation_;
+    AngularMotion spinMotion_;
+    AngularMotion orbitMotion_;
     void drawSide();
 public:
     SatelliteObject(GLdouble distance);
     virtual ~SatelliteObject();
     virtual void Initialize();
-    virtual void Draw();
+    virtual void GetLocalMatrix(Matrix & victim) const;
+    virtual GLfloat GetRadius() const;
+    virtual void SetTime(GLdouble seconds);
+    virtual void DrawGeometry();
     void SetRotation(GLdouble value);
     void SetOrbitRotation(GLdouble value);
     void AddRotation(GLdouble value);
     void AddOrbitRotation(GLdouble value);
+    void SetSpinMotion(const AngularMotion & value);
+    void SetOrbitMotion(const AngularMotion & value);
+};
+
+//----------------------------------------------------------------------------------------------------
+// ConstellationObject
+//----------------------------------------------------------------------------------------------------
+
+// Group of satellites drawn with a single glDrawArrays. The orbits are stored as an array for each
+// field, and SetTime computes a transform for each satellite and applies it to a copy of the model,
+// in parallel with the shared ThreadPool. The model of a satellite is the same as SatelliteObject,
+// rotated to its orbit and scaled by size.
+
+class ConstellationObject : public NodeObject {
+public:
+    static const int MODEL_VERTICES = 48, TRANSFORM_LENGTH = 16;
+
+private:
+    GLfloat size_;
+    GLfloat maxRadius_;
+    std::vector<GLfloat> radii_;
+    std::vector<GLfloat> phases_;
+    std::vector<GLfloat> rates_;
+    std::vector<GLfloat> inclinations_;
+    std::vector<GLfloat> spins_;
+    std::vector<GLfloat> transforms_;
+    std::vector<GLfloat> vertices_;
+    std::vector<GLfloat> normals_;
+    std::vector<GLfloat> colors_;
+    void computeTransforms(size_t begin, size_t end, GLdouble seconds);
+    void transformModels(size_t begin, size_t end);
+public:
+    ConstellationObject(GLfloat size);
+    virtual ~ConstellationObject();
+    inline size_t Size() const { return radii_.size(); }
+    inline const GLfloat * GetTransform(size_t index) const { return &transforms_[index * TRANSFORM_LENGTH]; }
+    inline const GLfloat * GetVertices() const { return vertices_.data(); }
+    virtual void Initialize();
+    virtual GLfloat GetRadius() const;
+    virtual void SetTime(GLdouble seconds);
+    virtual void DrawGeometry();
+    void Add(GLfloat radius, GLfloat phase, GLfloat rate, GLfloat inclination, GLfloat spin);
+    void Generate(size_t count, GLfloat minRadius, GLfloat maxRadius, GLfloat rate, unsigned int seed);
+};
+
+//----------------------------------------------------------------------------------------------------
+// BeltObject
+//----------------------------------------------------------------------------------------------------
+
+// Belt of small bodies scattered between two radii, with its own orbital rate and spin for each one,
+// stored as an array for each field. Every body uses one of a few low-poly rock meshes. PrepareView
+// culls the bodies with the frustum, draws the ones smaller than POINT_PIXELS as points and copies
+// the rest of them transformed into a single array of triangles. The updates are made in parallel.
+
+class BeltObject : public NodeObject {
+public:
+    static const int ROCK_MESHES = 4, ROCK_VERTICES = 60;
+    static const GLfloat POINT_PIXELS;
+
+private:
+    enum BodyClass { CULLED_BODY, POINT_BODY, ROCK_BODY };
+
+    GLfloat maxRadius_;
+    GLfloat maxHeight_;
+    GLfloat maxSize_;
+    std::vector<GLfloat> radii_;
+    std::vector<GLfloat> phases_;
+    std::vector<GLfloat> rates_;
+    std::vector<GLfloat> heights_;
+    std::vector<GLfloat> spins_;
+    std::vector<GLfloat> sizes_;
+    std::vector<unsigned char> meshes_;
+    std::vector<GLfloat> xs_;
+    std::vector<GLfloat> zs_;
+    std::vector<GLfloat> angles_;
+    std::vector<unsigned char> classes_;
+    std::vector<GLuint> rocks_;
+    std::vector<GLfloat> rockVertices_;
+    std::vector<GLfloat> rockNormals_;
+    std::vector<GLfloat> points_;
+    size_t culled_;
+    bool kinematic_;
+    void computePositions(size_t begin, size_t end, GLdouble seconds);
+    void classify(size_t begin, size_t end, const SceneView & view, const Matrix & world);
+    void transformRocks(size_t begin, size_t end);
+public:
+    BeltObject();
+    virtual ~BeltObject();
+    inline size_t Size() const { return radii_.size(); }
+    inline size_t GetRocks() const { return rocks_.size(); }
+    inline size_t GetPoints() const { return points_.size() / 3; }
+    inline size_t GetCulled() const { return culled_; }
+    virtual void Initialize();
+    virtual GLfloat GetRadius() const;
+    virtual void PrepareView(const SceneView & view, const Matrix & world);
+    virtual void SetTime(GLdouble seconds);
+    virtual void DrawGeometry();
+    void Add(GLfloat radius, GLfloat phase, GLfloat rate, GLfloat height, GLfloat spin, GLfloat size,
+        unsigned char mesh);
+    void Generate(size_t count, GLfloat minRadius, GLfloat maxRadius, GLfloat thickness, GLfloat rate,
+        unsigned int seed);
+    void GetPosition(size_t index, GLfloat * position) const;
+    void SetPosition(size_t index, const GLfloat * position);
+    void SetKinematic(bool value);
 };
 
 //----------------------------------------------------------------------------------------------------
@@ -127,7 +257,8 @@ public:
     AxesObject ();
     virtual ~AxesObject ();
     virtual void Initialize ();
-    virtual void Draw ();
+    virtual Pass GetPass () const;
+    virtual void DrawGeometry ();
 };
 
 #endif
@@ -29,6 +29,14 @@
 #include <algorithm>
 #include <cstdio>
 #include <cmath>
+#include <random>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 //****************************************************************************************************
 //*************************************** General structures *****************************************
@@ -54,72 +62,18 @@ static void GLfloat4Set(GLfloat * victim, GLfloat v0, GLfloat v1, GLfloat v2, GL
 // class Coordinates:
 //====================================================================================================
 
-const int Coordinates::X_IDX = 0;
-const int Coordinates::Y_IDX = 1;
-const int Coordinates::Z_IDX = 2;
-const int Coordinates::W_IDX = 3;
-
-const GLfloat Coordinates::W_AS_VECTOR = 0.0f;
-const GLfloat Coordinates::W_AS_POINT = 1.0f;
-
-//----------------------------------------------------------------------------------------------------
-// Constructors:
-//----------------------------------------------------------------------------------------------------
-
-Coordinates::Coordinates(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
-    Set(x, y, z, w);
-}
-
-Coordinates::Coordinates(const GLfloat * data) {
-    Set(data);
-}
-
-Coordinates::Coordinates(const Coordinates & victim) {
-    Set(victim);
-}
-
-//----------------------------------------------------------------------------------------------------
-// Methods:
-//----------------------------------------------------------------------------------------------------
-
-const GLfloat * Coordinates::Get() const {
-    return data_;
-}
-
-void Coordinates::Set(const Coordinates & value) {
-    memcpy(data_, value.data_, ARRAY4_LENGTH * sizeof(GLfloat));
-    validateChanges();
-}
-
-void Coordinates::Set(const GLfloat * data) {
-    memcpy(data_, data, ARRAY4_LENGTH * sizeof(GLfloat));
-    validateChanges();
-}
-
-void Coordinates::Set(GLfloat x, GLfloat y, GLfloat z) {
-    data_[X_IDX] = x;
-    data_[Y_IDX] = y;
-    data_[Z_IDX] = z;
-    validateChanges();
-}
+const int Coordinates::X_IDX;
+const int Coordinates::Y_IDX;
+const int Coordinates::Z_IDX;
+const int Coordinates::W_IDX;
 
-void Coordinates::Set(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
-    data_[X_IDX] = x;
-    data_[Y_IDX] = y;
-    data_[Z_IDX] = z;
-    data_[W_IDX] = w;
-    validateChanges();
-}
+const GLfloat Coordinates::W_AS_VECTOR;
+const GLfloat Coordinates::W_AS_POINT;
 
 //----------------------------------------------------------------------------------------------------
 // Operators:
 //----------------------------------------------------------------------------------------------------
 
-Coordinates & Coordinates::operator =(const Coordinates & rhs) {
-    Set(rhs);
-    return *this;
-}
-
 bool Coordinates::operator ==(const Coordinates & rhs) const {
     return data_[X_IDX] == rhs.data_[X_IDX] && data_[Y_IDX] == rhs.data_[Y_IDX] &&
            data_[Z_IDX] == rhs.data_[Z_IDX] && data_[W_IDX] == rhs.data_[W_IDX];
@@ -136,63 +90,6 @@ bool Coordinates::operator !=(const Coordinates & rhs) const {
 
 const Point3 Point3::ZERO(0.0f, 0.0f, 0.0f);
 
-//----------------------------------------------------------------------------------------------------
-// Constructors:
-//----------------------------------------------------------------------------------------------------
-
-Point3::Point3 (GLfloat x, GLfloat y, GLfloat z) : Coordinates(x, y, z, W_AS_POINT) {}
-
-Point3::Point3 (const GLfloat * data) : Coordinates(data) {}
-
-Point3::Point3 (const Point3 & victim) : Coordinates(victim) {}
-
-Point3::Point3 (const Vector3 & victim) : Coordinates(victim.data_[X_IDX], victim.data_[Y_IDX],
-    victim.data_[Z_IDX], W_AS_POINT) {}
-
-//----------------------------------------------------------------------------------------------------
-// Methods:
-//----------------------------------------------------------------------------------------------------
-
-void Point3::validateChanges() {
-    data_[W_IDX] = W_AS_POINT;
-}
-
-//----------------------------------------------------------------------------------------------------
-// Operators:
-//----------------------------------------------------------------------------------------------------
-
-Point3 Point3::operator +(const Vector3 & rhs) {
-    return Point3(
-        data_[X_IDX] + rhs.data_[X_IDX],
-        data_[Y_IDX] + rhs.data_[Y_IDX],
-        data_[Z_IDX] + rhs.data_[Z_IDX]
-    );
-}
-
-Point3 Point3::operator -(const Vector3 & rhs) {
-    return Point3(
-        data_[X_IDX] - rhs.data_[X_IDX],
-        data_[Y_IDX] - rhs.data_[Y_IDX],
-        data_[Z_IDX] - rhs.data_[Z_IDX]
-    );
-}
-
-Point3 Point3::operator *(const Vector3 & rhs) {
-    return Point3(
-        data_[X_IDX] * rhs.data_[X_IDX],
-        data_[Y_IDX] * rhs.data_[Y_IDX],
-        data_[Z_IDX] * rhs.data_[Z_IDX]
-    );
-}
-
-Point3 Point3::operator /(const Vector3 & rhs) {
-    return Point3(
-        data_[X_IDX] / rhs.data_[X_IDX],
-        data_[Y_IDX] / rhs.data_[Y_IDX],
-        data_[Z_IDX] / rhs.data_[Z_IDX]
-    );
-}
-
 //====================================================================================================
 // class Vector3:
 //====================================================================================================
@@ -209,37 +106,14 @@ const Vector3 Vector3::DOWN(0.0f, -1.0f, 0.0f);
 const Vector3 Vector3::FORWARD(0.0f, 0.0f, -1.0f);
 const Vector3 Vector3::BACKWARD(0.0f, 0.0f, 1.0f);
 
-//----------------------------------------------------------------------------------------------------
-// Constructors:
-//----------------------------------------------------------------------------------------------------
-
-Vector3::Vector3 (GLfloat x, GLfloat y, GLfloat z) : Coordinates(x, y, z, W_AS_VECTOR) {}
-
-Vector3::Vector3 (const GLfloat * data) : Coordinates(data) {}
-
-Vector3::Vector3 (const Vector3 & victim) : Coordinates(victim) {}
-
-Vector3::Vector3 (const Point3 & victim) : Coordinates(victim.data_[X_IDX], victim.data_[Y_IDX],
-    victim.data_[Z_IDX], W_AS_VECTOR) {}
-
 //----------------------------------------------------------------------------------------------------
 // Methods:
 //----------------------------------------------------------------------------------------------------
 
-void Vector3::validateChanges() {
-    data_[W_IDX] = W_AS_VECTOR;
-}
-
 GLfloat Vector3::Length() const {
     return std::sqrt(LengthSquared());
 }
 
-GLfloat Vector3::LengthSquared() const {
-    return data_[X_IDX] * data_[X_IDX] +
-           data_[Y_IDX] * data_[Y_IDX] +
-           data_[Z_IDX] * data_[Z_IDX];
-}
-
 GLfloat Vector3::Distance(const Vector3 & rhs) const {
     return std::sqrt(DistanceSquared(rhs));
 }
@@ -269,105 +143,19 @@ GLfloat Vector3::Angle(const Vector3 & rhs) const {
     return RadToDeg(std::acos(Dot(rhs) / (Length() * rhs.Length())));
 }
 
-GLfloat Vector3::Dot(const Vector3 & rhs) const {
-    return data_[X_IDX] * rhs.data_[X_IDX] +
-           data_[Y_IDX] * rhs.data_[Y_IDX] +
-           data_[Z_IDX] * rhs.data_[Z_IDX];
-}
-
-Vector3 Vector3::Cross(const Vector3 & rhs) const {
-    return Vector3(
-        data_[Y_IDX] * rhs.data_[Z_IDX] - data_[Z_IDX] * rhs.data_[Y_IDX],
-        data_[Z_IDX] * rhs.data_[X_IDX] - data_[X_IDX] * rhs.data_[Z_IDX],
-        data_[X_IDX] * rhs.data_[Y_IDX] - data_[Y_IDX] * rhs.data_[X_IDX]
-    );
-}
-
-//----------------------------------------------------------------------------------------------------
-// Operators:
-//----------------------------------------------------------------------------------------------------
-
-Vector3 Vector3::operator -() const {
-    return Vector3(-data_[X_IDX], -data_[Y_IDX], -data_[Z_IDX]);
-}
-
-Vector3 Vector3::operator +(const Vector3 & rhs) const {
-    return Vector3(
-        data_[X_IDX] + rhs.data_[X_IDX],
-        data_[Y_IDX] + rhs.data_[Y_IDX],
-        data_[Z_IDX] + rhs.data_[Z_IDX]
-    );
-}
-
-Vector3 Vector3::operator -(const Vector3 & rhs) const {
-    return Vector3(
-        data_[X_IDX] - rhs.data_[X_IDX],
-        data_[Y_IDX] - rhs.data_[Y_IDX],
-        data_[Z_IDX] - rhs.data_[Z_IDX]
-    );
-}
-
-Vector3 Vector3::operator *(const Vector3 & rhs) const {
-    return Vector3(
-        data_[X_IDX] * rhs.data_[X_IDX],
-        data_[Y_IDX] * rhs.data_[Y_IDX],
-        data_[Z_IDX] * rhs.data_[Z_IDX]
-    );
-}
-
-Vector3 Vector3::operator /(const Vector3 & rhs) const {
-    return Vector3(
-        data_[X_IDX] / rhs.data_[X_IDX],
-        data_[Y_IDX] / rhs.data_[Y_IDX],
-        data_[Z_IDX] / rhs.data_[Z_IDX]
-    );
-}
-
-Vector3 operator *(const Vector3 & lhs, GLfloat rhs) {
-    return Vector3(
-        lhs.data_[Coordinates::X_IDX] * rhs,
-        lhs.data_[Coordinates::Y_IDX] * rhs,
-        lhs.data_[Coordinates::Z_IDX] * rhs
-    );
-}
-
-Vector3 operator *(GLfloat lhs, const Vector3 & rhs) {
-    return Vector3(
-        rhs.data_[Coordinates::X_IDX] * lhs,
-        rhs.data_[Coordinates::Y_IDX] * lhs,
-        rhs.data_[Coordinates::Z_IDX] * lhs
-    );
-}
-
-Vector3 operator /(const Vector3 & lhs, GLfloat rhs) {
-    return Vector3(
-        lhs.data_[Coordinates::X_IDX] / rhs,
-        lhs.data_[Coordinates::Y_IDX] / rhs,
-        lhs.data_[Coordinates::Z_IDX] / rhs
-    );
-}
-
-Vector3 operator /(GLfloat lhs, const Vector3 & rhs) {
-    return Vector3(
-        rhs.data_[Coordinates::X_IDX] / lhs,
-        rhs.data_[Coordinates::Y_IDX] / lhs,
-        rhs.data_[Coordinates::Z_IDX] / lhs
-    );
-}
-
 //====================================================================================================
 // class Quaternion:
 //====================================================================================================
 
+const Quaternion Quaternion::IDENTITY(0.0f, 0.0f, 0.0f, 1.0f);
+
 //----------------------------------------------------------------------------------------------------
 // Constructors:
 //----------------------------------------------------------------------------------------------------
 
-Quaternion::Quaternion (GLfloat x, GLfloat y, GLfloat z, GLfloat w) : Coordinates(x, y, z, w) {}
+Quaternion::Quaternion (GLfloat x, GLfloat y, GLfloat z, GLfloat w) : TypedCoordinates(x, y, z, w) {}
 
-Quaternion::Quaternion (const GLfloat * data) : Coordinates(data) {}
-
-Quaternion::Quaternion (const Quaternion & victim) : Coordinates(victim) {}
+Quaternion::Quaternion (const GLfloat * data) : TypedCoordinates(data) {}
 
 //----------------------------------------------------------------------------------------------------
 // Methods:
@@ -402,10 +190,245 @@ void Quaternion::Normalize() {
     data_[W_IDX] /= norm;
 }
 
+GLfloat Quaternion::Dot (const Quaternion & rhs) const {
+    return data_[X_IDX] * rhs.data_[X_IDX] +
+           data_[Y_IDX] * rhs.data_[Y_IDX] +
+           data_[Z_IDX] * rhs.data_[Z_IDX] +
+           data_[W_IDX] * rhs.data_[W_IDX];
+}
+
 Quaternion Quaternion::Conjugate () const {
     return Quaternion(-data_[X_IDX], -data_[Y_IDX], -data_[Z_IDX], data_[W_IDX]);
 }
 
+Quaternion Quaternion::Inverse () const {
+    GLfloat norm = LengthSquared();
+    return Quaternion(
+        -data_[X_IDX] / norm,
+        -data_[Y_IDX] / norm,
+        -data_[Z_IDX] / norm,
+         data_[W_IDX] / norm
+    );
+}
+
+Matrix Quaternion::ToMatrix () const {
+    // The quaternion must be normalized:
+    GLfloat x = data_[X_IDX], y = data_[Y_IDX], z = data_[Z_IDX], w = data_[W_IDX];
+    GLfloat xx = x * x, yy = y * y, zz = z * z;
+    GLfloat xy = x * y, xz = x * z, yz = y * z;
+    GLfloat wx = w * x, wy = w * y, wz = w * z;
+    Matrix result;
+    result.Set(0, 0, 1.0f - 2.0f * (yy + zz));
+    result.Set(0, 1, 2.0f * (xy - wz));
+    result.Set(0, 2, 2.0f * (xz + wy));
+    result.Set(1, 0, 2.0f * (xy + wz));
+    result.Set(1, 1, 1.0f - 2.0f * (xx + zz));
+    result.Set(1, 2, 2.0f * (yz - wx));
+    result.Set(2, 0, 2.0f * (xz - wy));
+    result.Set(2, 1, 2.0f * (yz + wx));
+    result.Set(2, 2, 1.0f - 2.0f * (xx + yy));
+    return result;
+}
+
+Vector3 Quaternion::Rotate (const Vector3 & victim) const {
+    // v' = v + w * t + u x t, where t = 2 * (u x v) and u = (x, y, z):
+    GLfloat x = data_[X_IDX], y = data_[Y_IDX], z = data_[Z_IDX], w = data_[W_IDX];
+    GLfloat vx = victim.X(), vy = victim.Y(), vz = victim.Z();
+    GLfloat tx = 2.0f * (y * vz - z * vy);
+    GLfloat ty = 2.0f * (z * vx - x * vz);
+    GLfloat tz = 2.0f * (x * vy - y * vx);
+    return Vector3(
+        vx + w * tx + (y * tz - z * ty),
+        vy + w * ty + (z * tx - x * tz),
+        vz + w * tz + (x * ty - y * tx)
+    );
+}
+
+Point3 Quaternion::Rotate (const Point3 & victim) const {
+    return Point3(Rotate(Vector3(victim)));
+}
+
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+Quaternion Quaternion::FromAxisAngle (const Vector3 & axis, GLfloat angle) {
+    // The angle is in degrees, like in glRotate, and a zero axis gives no rotation:
+    GLfloat s, c, norm = axis.Length();
+    if (norm == 0.0f) return IDENTITY;
+    SinCos(DegToRad(angle) * 0.5f, s, c);
+    s /= norm;
+    return Quaternion(axis.X() * s, axis.Y() * s, axis.Z() * s, c);
+}
+
+Quaternion Quaternion::FromMatrix (const Matrix & victim) {
+    // The 3x3 part of the matrix must be a rotation:
+    GLfloat m00 = victim.Get(0, 0), m01 = victim.Get(0, 1), m02 = victim.Get(0, 2);
+    GLfloat m10 = victim.Get(1, 0), m11 = victim.Get(1, 1), m12 = victim.Get(1, 2);
+    GLfloat m20 = victim.Get(2, 0), m21 = victim.Get(2, 1), m22 = victim.Get(2, 2);
+    GLfloat trace = m00 + m11 + m22;
+    if (trace > 0.0f) {
+        GLfloat s = std::sqrt(trace + 1.0f) * 2.0f;
+        return Quaternion((m21 - m12) / s, (m02 - m20) / s, (m10 - m01) / s, 0.25f * s);
+    } else if (m00 > m11 && m00 > m22) {
+        GLfloat s = std::sqrt(1.0f + m00 - m11 - m22) * 2.0f;
+        return Quaternion(0.25f * s, (m01 + m10) / s, (m02 + m20) / s, (m21 - m12) / s);
+    } else if (m11 > m22) {
+        GLfloat s = std::sqrt(1.0f + m11 - m00 - m22) * 2.0f;
+        return Quaternion((m01 + m10) / s, 0.25f * s, (m12 + m21) / s, (m02 - m20) / s);
+    } else {
+        GLfloat s = std::sqrt(1.0f + m22 - m00 - m11) * 2.0f;
+        return Quaternion((m02 + m20) / s, (m12 + m21) / s, 0.25f * s, (m10 - m01) / s);
+    }
+}
+
+Quaternion Quaternion::Nlerp (const Quaternion & from, const Quaternion & to, GLfloat amount) {
+    GLfloat a = 1.0f - amount, b = from.Dot(to) < 0.0f ? -amount : amount;
+    Quaternion result(
+        a * from.data_[X_IDX] + b * to.data_[X_IDX],
+        a * from.data_[Y_IDX] + b * to.data_[Y_IDX],
+        a * from.data_[Z_IDX] + b * to.data_[Z_IDX],
+        a * from.data_[W_IDX] + b * to.data_[W_IDX]
+    );
+    result.Normalize();
+    return result;
+}
+
+Quaternion Quaternion::Slerp (const Quaternion & from, const Quaternion & to, GLfloat amount) {
+    GLfloat cosine = from.Dot(to), sign = 1.0f;
+    if (cosine < 0.0f) {
+        cosine = -cosine;
+        sign = -1.0f;
+    }
+    if (cosine > 0.9995f) {
+        // The angle is too small to divide by its sine:
+        return Nlerp(from, to, amount);
+    }
+    GLfloat angle = std::acos(cosine);
+    GLfloat sine = std::sin(angle);
+    GLfloat a = std::sin((1.0f - amount) * angle) / sine;
+    GLfloat b = sign * std::sin(amount * angle) / sine;
+    return Quaternion(
+        a * from.data_[X_IDX] + b * to.data_[X_IDX],
+        a * from.data_[Y_IDX] + b * to.data_[Y_IDX],
+        a * from.data_[Z_IDX] + b * to.data_[Z_IDX],
+        a * from.data_[W_IDX] + b * to.data_[W_IDX]
+    );
+}
+
+//----------------------------------------------------------------------------------------------------
+// Batch methods:
+//----------------------------------------------------------------------------------------------------
+
+void Quaternion::Rotate (const Quaternion & rotation, const Vector3 * source, Vector3 * destination,
+    size_t count) {
+    size_t i = 0;
+#ifdef GSYSTEM_SSE
+    // Four vectors for each iteration, transposed to x/y/z/w registers:
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 x = _mm_set1_ps(rotation.X()), y = _mm_set1_ps(rotation.Y());
+    const __m128 z = _mm_set1_ps(rotation.Z()), w = _mm_set1_ps(rotation.W());
+    for (; i + 4 <= count; i += 4) {
+        __m128 vx = source[i].Simd(), vy = source[i + 1].Simd();
+        __m128 vz = source[i + 2].Simd(), vw = source[i + 3].Simd();
+        _MM_TRANSPOSE4_PS(vx, vy, vz, vw);
+        __m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(y, vz), _mm_mul_ps(z, vy)));
+        __m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(z, vx), _mm_mul_ps(x, vz)));
+        __m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(x, vy), _mm_mul_ps(y, vx)));
+        vx = _mm_add_ps(_mm_add_ps(vx, _mm_mul_ps(w, tx)), _mm_sub_ps(_mm_mul_ps(y, tz), _mm_mul_ps(z, ty)));
+        vy = _mm_add_ps(_mm_add_ps(vy, _mm_mul_ps(w, ty)), _mm_sub_ps(_mm_mul_ps(z, tx), _mm_mul_ps(x, tz)));
+        vz = _mm_add_ps(_mm_add_ps(vz, _mm_mul_ps(w, tz)), _mm_sub_ps(_mm_mul_ps(x, ty), _mm_mul_ps(y, tx)));
+        _MM_TRANSPOSE4_PS(vx, vy, vz, vw);
+        destination[i].Simd(vx);
+        destination[i + 1].Simd(vy);
+        destination[i + 2].Simd(vz);
+        destination[i + 3].Simd(vw);
+    }
+#endif
+    for (; i < count; ++i) {
+        destination[i] = rotation.Rotate(source[i]);
+    }
+}
+
+// Polynomial approximation of slerp without trigonometric functions, from "A Fast and Accurate
+// Algorithm for Computing SLERP" by David Eberly. The series for sin(t * a) / sin(a) is expanded
+// around cos(a) = 1 and the last term is corrected with a fitted factor. With 12 terms the max
+// error is ~7e-7 when the angle between the quaternions is below 90 degrees:
+static const int SLERP_TERMS = 12;
+static const GLfloat SLERP_MU = 1.8937f;
+static const GLfloat SLERP_U[SLERP_TERMS] = {
+    1.0f / (1.0f * 3.0f), 1.0f / (2.0f * 5.0f), 1.0f / (3.0f * 7.0f), 1.0f / (4.0f * 9.0f),
+    1.0f / (5.0f * 11.0f), 1.0f / (6.0f * 13.0f), 1.0f / (7.0f * 15.0f), 1.0f / (8.0f * 17.0f),
+    1.0f / (9.0f * 19.0f), 1.0f / (10.0f * 21.0f), 1.0f / (11.0f * 23.0f), SLERP_MU / (12.0f * 25.0f)
+};
+static const GLfloat SLERP_V[SLERP_TERMS] = {
+    1.0f / 3.0f, 2.0f / 5.0f, 3.0f / 7.0f, 4.0f / 9.0f, 5.0f / 11.0f, 6.0f / 13.0f,
+    7.0f / 15.0f, 8.0f / 17.0f, 9.0f / 19.0f, 10.0f / 21.0f, 11.0f / 23.0f, SLERP_MU * 12.0f / 25.0f
+};
+
+static GLfloat SlerpCoefficient (GLfloat amount, GLfloat cosineMinusOne) {
+    GLfloat square = amount * amount, result = 1.0f;
+    for (int k = SLERP_TERMS - 1; k >= 0; --k) {
+        result = 1.0f + result * (SLERP_U[k] * square - SLERP_V[k]) * cosineMinusOne;
+    }
+    return amount * result;
+}
+
+void Quaternion::Slerp (const Quaternion * from, const Quaternion * to, GLfloat amount,
+    Quaternion * destination, size_t count) {
+    size_t i = 0;
+#ifdef GSYSTEM_SSE
+    // Four pairs for each iteration, transposed to x/y/z/w registers:
+    const __m128 one = _mm_set1_ps(1.0f), signMask = _mm_set1_ps(-0.0f);
+    const __m128 t = _mm_set1_ps(amount), d = _mm_set1_ps(1.0f - amount);
+    const __m128 tt = _mm_mul_ps(t, t), dd = _mm_mul_ps(d, d);
+    for (; i + 4 <= count; i += 4) {
+        __m128 ax = from[i].Simd(), ay = from[i + 1].Simd();
+        __m128 az = from[i + 2].Simd(), aw = from[i + 3].Simd();
+        __m128 bx = to[i].Simd(), by = to[i + 1].Simd();
+        __m128 bz = to[i + 2].Simd(), bw = to[i + 3].Simd();
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+        __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+                                   _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        __m128 sign = _mm_and_ps(cosine, signMask);
+        __m128 xm1 = _mm_sub_ps(_mm_xor_ps(cosine, sign), one);
+        __m128 ct = one, cd = one;
+        for (int k = SLERP_TERMS - 1; k >= 0; --k) {
+            __m128 u = _mm_set1_ps(SLERP_U[k]), v = _mm_set1_ps(SLERP_V[k]);
+            ct = _mm_add_ps(one, _mm_mul_ps(ct, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, tt), v), xm1)));
+            cd = _mm_add_ps(one, _mm_mul_ps(cd, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, dd), v), xm1)));
+        }
+        ct = _mm_xor_ps(_mm_mul_ps(t, ct), sign);
+        cd = _mm_mul_ps(d, cd);
+        ax = _mm_add_ps(_mm_mul_ps(cd, ax), _mm_mul_ps(ct, bx));
+        ay = _mm_add_ps(_mm_mul_ps(cd, ay), _mm_mul_ps(ct, by));
+        az = _mm_add_ps(_mm_mul_ps(cd, az), _mm_mul_ps(ct, bz));
+        aw = _mm_add_ps(_mm_mul_ps(cd, aw), _mm_mul_ps(ct, bw));
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        destination[i].Simd(ax);
+        destination[i + 1].Simd(ay);
+        destination[i + 2].Simd(az);
+        destination[i + 3].Simd(aw);
+    }
+#endif
+    for (; i < count; ++i) {
+        GLfloat cosine = from[i].Dot(to[i]), sign = 1.0f;
+        if (cosine < 0.0f) {
+            cosine = -cosine;
+            sign = -1.0f;
+        }
+        GLfloat cd = SlerpCoefficient(1.0f - amount, cosine - 1.0f);
+        GLfloat ct = sign * SlerpCoefficient(amount, cosine - 1.0f);
+        destination[i] = Quaternion(
+            cd * from[i].X() + ct * to[i].X(),
+            cd * from[i].Y() + ct * to[i].Y(),
+            cd * from[i].Z() + ct * to[i].Z(),
+            cd * from[i].W() + ct * to[i].W()
+        );
+    }
+}
+
 //----------------------------------------------------------------------------------------------------
 // Operators:
 //----------------------------------------------------------------------------------------------------
@@ -423,84 +446,519 @@ Quaternion Quaternion::operator * (Quaternion rhs) const {
     );
 }
 
-//****************************************************************************************************
-//******************************************** Materials *********************************************
-//****************************************************************************************************
-
 //====================================================================================================
-// Types:
+// class Matrix:
 //====================================================================================================
 
-struct TargaFileHeader {
-    BYTE  imageIDLength;     // ID field length (=0)
-    BYTE  colorMapType;      // = 0;
-    BYTE  imageTypeCode;     // = 2; (RGB uncompressed)
-                             // = 3; (Grayscale uncompressed)
-    INT16 colorMapOrigin;    // = 0;
-    INT16 colorMapLength;    // = 0;
-    INT16 colorMapEntrySize; // = 0;
-    INT16 imageXOrigin;      // = 0;
-    INT16 imageYOrigin;      // = 0;
-    INT16 imageWidth;        // Width in pixels of the image.
-    INT16 imageHeight;       // Height in pixels of the image.
-    BYTE  bitCount;          // Color depth (16, 24, 32)
-    BYTE  imageDescriptor;   // 24bits = 0x00, 32bits = 0x08
-};
+const Matrix Matrix::IDENTITY;
 
-struct TargaFile {
-    BYTE   imageTypeCode;
-    INT16  imageWidth;
-    INT16  imageHeight;
-    BYTE   bitCount;
-    BYTE * imageData;
-};
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
 
-//====================================================================================================
-// Functions:
-//====================================================================================================
+Matrix::Matrix () {
+    SetAsIdentity();
+}
 
-unsigned char * LoadBitmapFile (const char * name, BITMAPINFOHEADER * info) {
-    // Open the file:
-    FILE * file = fopen(name, "rb");
-    if(file == nullptr) return nullptr;
+Matrix::Matrix (const GLfloat * data) {
+    Set(data);
+}
 
-    // Read the header and check we have a bmp:
-    BITMAPFILEHEADER header;
-    fread(&header, sizeof(BITMAPFILEHEADER), 1, file);
-    if(header.bfType != 0x4D42) {
-        fclose(file);
-        return nullptr;
-    }
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
 
-    // Read another the header and check that the bmp is uncompressed:
-    fread(info, sizeof(BITMAPINFOHEADER), 1, file);
-    if(info->biCompression != BI_RGB) {
-        fclose(file);
-        return nullptr;
+void Matrix::Set (const GLfloat * data) {
+    memcpy(data_, data, LENGTH * sizeof(GLfloat));
+}
+
+void Matrix::SetAsIdentity () {
+    for (int i = 0; i < LENGTH; ++i) {
+        data_[i] = (i % (SIDE + 1)) == 0 ? 1.0f : 0.0f;
     }
+}
 
-    // Move the pointer to the section with the pixels:
-    fseek(file, header.bfOffBits, SEEK_SET);
+void Matrix::SetAsTranslate (GLfloat x, GLfloat y, GLfloat z) {
+    SetAsIdentity();
+    Set(0, 3, x);
+    Set(1, 3, y);
+    Set(2, 3, z);
+}
+
+void Matrix::SetAsScale (GLfloat x, GLfloat y, GLfloat z) {
+    SetAsIdentity();
+    Set(0, 0, x);
+    Set(1, 1, y);
+    Set(2, 2, z);
+}
+
+void Matrix::SetAsRotate (GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+    // The angle is in degrees, like in glRotate:
+    *this = Quaternion::FromAxisAngle(Vector3(x, y, z), angle).ToMatrix();
+}
+
+void Matrix::SetAsOrtho (GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar) {
+    // Same as glOrtho:
+    SetAsIdentity();
+    Set(0, 0, 2.0f / (right - left));
+    Set(1, 1, 2.0f / (top - bottom));
+    Set(2, 2, -2.0f / (zFar - zNear));
+    Set(0, 3, -(right + left) / (right - left));
+    Set(1, 3, -(top + bottom) / (top - bottom));
+    Set(2, 3, -(zFar + zNear) / (zFar - zNear));
+}
+
+void Matrix::SetAsPerspective (GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar) {
+    // Same as gluPerspective, the angle is in degrees:
+    GLfloat sine, cosine;
+    SinCos(DegToRad(fovy) * 0.5f, sine, cosine);
+    GLfloat f = cosine / sine;
+    memset(data_, 0, LENGTH * sizeof(GLfloat));
+    Set(0, 0, f / aspect);
+    Set(1, 1, f);
+    Set(2, 2, (zFar + zNear) / (zNear - zFar));
+    Set(2, 3, (2.0f * zFar * zNear) / (zNear - zFar));
+    Set(3, 2, -1.0f);
+}
+
+void Matrix::SetAsLookAt (const Point3 & eye, const Point3 & look, const Vector3 & up) {
+    // Same as gluLookAt:
+    Vector3 forward = Vector3(look) - Vector3(eye);
+    forward.Normalize();
+    Vector3 side = forward.Cross(up);
+    side.Normalize();
+    Vector3 top = side.Cross(forward);
+    Vector3 position(eye);
+    SetAsIdentity();
+    Set(0, 0, side.X()), Set(0, 1, side.Y()), Set(0, 2, side.Z());
+    Set(1, 0, top.X()), Set(1, 1, top.Y()), Set(1, 2, top.Z());
+    Set(2, 0, -forward.X()), Set(2, 1, -forward.Y()), Set(2, 2, -forward.Z());
+    Set(0, 3, -side.Dot(position));
+    Set(1, 3, -top.Dot(position));
+    Set(2, 3, forward.Dot(position));
+}
+
+void Matrix::AddTranslate (GLfloat x, GLfloat y, GLfloat z) {
+    // Only the last column changes: M * T = [c0 c1 c2 c0*x+c1*y+c2*z+c3]
+    for (int i = 0; i < SIDE; ++i) {
+        Set(i, 3, Get(i, 0) * x + Get(i, 1) * y + Get(i, 2) * z + Get(i, 3));
+    }
+}
 
-    // Ask memory for the image's buffer:
-    BYTE  colormode = info->biBitCount / 8;
-    DWORD imagesize = info->biWidth * info->biHeight * colormode;
-    unsigned char * buffer = new unsigned char[imagesize];
-    if(buffer == nullptr) {
-        fclose(file);
-        return nullptr;
+void Matrix::AddScale (GLfloat x, GLfloat y, GLfloat z) {
+    // Only the first three columns change: M * S = [c0*x c1*y c2*z c3]
+    for (int i = 0; i < SIDE; ++i) {
+        Set(i, 0, Get(i, 0) * x);
+        Set(i, 1, Get(i, 1) * y);
+        Set(i, 2, Get(i, 2) * z);
     }
+}
 
-    // Read the contents of the image:
-    fread(buffer, 1, imagesize, file);
+void Matrix::AddRotate (GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+    Matrix rotation;
+    rotation.SetAsRotate(angle, x, y, z);
+    Multiply(data_, rotation.data_, data_);
+}
 
-    // Convert pixels from BGR to RGB:
-    unsigned char temprgb;
-    for(DWORD imgidx = 0; imgidx < imagesize; imgidx += 3) {
-        temprgb = buffer[imgidx];
-        buffer[imgidx] = buffer[imgidx + 2];
-        buffer[imgidx + 2] = temprgb;
-    }
+void Matrix::AddMultiply (const Matrix & rhs) {
+    Multiply(data_, rhs.data_, data_);
+}
+
+void Matrix::LoadInOpenGL () const {
+    glLoadMatrixf(data_);
+}
+
+void Matrix::MultiplyInOpenGL () const {
+    glMultMatrixf(data_);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Operators:
+//----------------------------------------------------------------------------------------------------
+
+Matrix Matrix::operator * (const Matrix & rhs) const {
+    Matrix result(*this);
+    Multiply(data_, rhs.data_, result.data_);
+    return result;
+}
+
+Point3 Matrix::operator * (const Point3 & rhs) const {
+    return Point3(
+        Get(0, 0) * rhs.X() + Get(0, 1) * rhs.Y() + Get(0, 2) * rhs.Z() + Get(0, 3),
+        Get(1, 0) * rhs.X() + Get(1, 1) * rhs.Y() + Get(1, 2) * rhs.Z() + Get(1, 3),
+        Get(2, 0) * rhs.X() + Get(2, 1) * rhs.Y() + Get(2, 2) * rhs.Z() + Get(2, 3)
+    );
+}
+
+Vector3 Matrix::operator * (const Vector3 & rhs) const {
+    return Vector3(
+        Get(0, 0) * rhs.X() + Get(0, 1) * rhs.Y() + Get(0, 2) * rhs.Z(),
+        Get(1, 0) * rhs.X() + Get(1, 1) * rhs.Y() + Get(1, 2) * rhs.Z(),
+        Get(2, 0) * rhs.X() + Get(2, 1) * rhs.Y() + Get(2, 2) * rhs.Z()
+    );
+}
+
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+void Matrix::Multiply (const GLfloat * lhs, const GLfloat * rhs, GLfloat * result) {
+    // result = lhs * rhs, the result can be the same as lhs or rhs:
+#ifdef GSYSTEM_SSE
+    __m128 c0 = _mm_loadu_ps(lhs), c1 = _mm_loadu_ps(lhs + 4);
+    __m128 c2 = _mm_loadu_ps(lhs + 8), c3 = _mm_loadu_ps(lhs + 12);
+    __m128 column[SIDE];
+    for (int j = 0; j < SIDE; ++j) {
+        const GLfloat * rj = rhs + j * SIDE;
+        __m128 v = _mm_mul_ps(c0, _mm_set1_ps(rj[0]));
+        v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(rj[1])));
+        v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(rj[2])));
+        v = _mm_add_ps(v, _mm_mul_ps(c3, _mm_set1_ps(rj[3])));
+        column[j] = v;
+    }
+    for (int j = 0; j < SIDE; ++j) {
+        _mm_storeu_ps(result + j * SIDE, column[j]);
+    }
+#else
+    GLfloat temp[LENGTH];
+    for (int j = 0; j < SIDE; ++j) {
+        for (int i = 0; i < SIDE; ++i) {
+            GLfloat v = 0.0f;
+            for (int k = 0; k < SIDE; ++k) {
+                v += lhs[k * SIDE + i] * rhs[j * SIDE + k];
+            }
+            temp[j * SIDE + i] = v;
+        }
+    }
+    memcpy(result, temp, LENGTH * sizeof(GLfloat));
+#endif
+}
+
+//====================================================================================================
+// class Frustum:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+Frustum::Frustum () {
+    Set(Matrix::IDENTITY);
+}
+
+Frustum::Frustum (const Matrix & victim) {
+    Set(victim);
+}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void Frustum::Set (const Matrix & victim) {
+    // Left, right, bottom, top, near and far planes, as the 4th row +/- the other rows:
+    for (int k = 0; k < PLANES; ++k) {
+        int row = k / 2;
+        GLfloat sign = (k % 2) == 0 ? 1.0f : -1.0f;
+        for (int j = 0; j < Matrix::SIDE; ++j) {
+            planes_[k][j] = victim.Get(3, j) + sign * victim.Get(row, j);
+        }
+        GLfloat length = std::sqrt(planes_[k][0] * planes_[k][0] + planes_[k][1] * planes_[k][1] +
+            planes_[k][2] * planes_[k][2]);
+        for (int j = 0; j < Matrix::SIDE; ++j) {
+            planes_[k][j] /= length;
+        }
+    }
+}
+
+Frustum::Result Frustum::Test (const Point3 & center, GLfloat radius) const {
+    Result result = INSIDE;
+    for (int k = 0; k < PLANES; ++k) {
+        const GLfloat * plane = planes_[k];
+        GLfloat distance = plane[0] * center.X() + plane[1] * center.Y() + plane[2] * center.Z() + plane[3];
+        if (distance < -radius) {
+            return OUTSIDE;
+        } else if (distance < radius) {
+            result = INTERSECT;
+        }
+    }
+    return result;
+}
+
+//====================================================================================================
+// class SceneView:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+SceneView::SceneView (const Matrix & projection, const Matrix & view, GLsizei viewportHeight) :
+    viewProjection_(projection * view), frustum_(viewProjection_),
+    pixelScale_(projection.Get(1, 1) * viewportHeight * 0.5f) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+GLfloat SceneView::ScreenRadius (const Point3 & center, GLfloat radius) const {
+    // The radius is divided by the clip w, that is 1 with an orthographic projection and the depth
+    // with a perspective one, and scaled from normalized coordinates to pixels:
+    const Matrix & m = viewProjection_;
+    GLfloat w = m.Get(3, 0) * center.X() + m.Get(3, 1) * center.Y() + m.Get(3, 2) * center.Z() + m.Get(3, 3);
+    const GLfloat MIN_W = 1e-3f;
+    if (w < MIN_W) {
+        w = MIN_W;
+    }
+    return radius * pixelScale_ / w;
+}
+
+//****************************************************************************************************
+//******************************************** Materials *********************************************
+//****************************************************************************************************
+
+//====================================================================================================
+// class GLState:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Data:
+//----------------------------------------------------------------------------------------------------
+
+GLState::Entry GLState::capabilities_[GLState::MAX_ENTRIES];
+GLState::Entry GLState::clientStates_[GLState::MAX_ENTRIES];
+int GLState::capabilityCount_ = 0, GLState::clientStateCount_ = 0;
+GLfloat GLState::lineWidth_ = 0.0f, GLState::pointSize_ = 0.0f, GLState::shininess_ = 0.0f;
+GLuint GLState::texture_ = 0;
+GLfloat4 GLState::color_;
+GLfloat4 GLState::material_[GLState::MATERIAL_COUNT];
+bool GLState::validLineWidth_ = false, GLState::validPointSize_ = false, GLState::validShininess_ = false;
+bool GLState::validTexture_ = false, GLState::validColor_ = false;
+bool GLState::validMaterial_[GLState::MATERIAL_COUNT] = { false, false, false, false };
+size_t GLState::issued_ = 0, GLState::skipped_ = 0;
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+bool GLState::change(Entry * entries, int & count, GLenum name, bool enabled) {
+    // Returns true when the call must be issued, the unknown states are always issued:
+    for (int i = 0; i < count; ++i) {
+        if (entries[i].name == name) {
+            if (entries[i].enabled == enabled) {
+                ++skipped_;
+                return false;
+            }
+            entries[i].enabled = enabled;
+            ++issued_;
+            return true;
+        }
+    }
+    if (count < MAX_ENTRIES) {
+        entries[count].name = name;
+        entries[count].enabled = enabled;
+        ++count;
+    }
+    ++issued_;
+    return true;
+}
+
+bool GLState::changeVector(GLfloat4 & shadow, bool & valid, const GLfloat * value) {
+    if (valid && memcmp(shadow, value, ARRAY4_LENGTH * sizeof(GLfloat)) == 0) {
+        ++skipped_;
+        return false;
+    }
+    memcpy(shadow, value, ARRAY4_LENGTH * sizeof(GLfloat));
+    valid = true;
+    ++issued_;
+    return true;
+}
+
+void GLState::Invalidate() {
+    capabilityCount_ = 0;
+    clientStateCount_ = 0;
+    validLineWidth_ = false;
+    validPointSize_ = false;
+    validShininess_ = false;
+    validTexture_ = false;
+    validColor_ = false;
+    for (int i = 0; i < MATERIAL_COUNT; ++i) {
+        validMaterial_[i] = false;
+    }
+}
+
+void GLState::InvalidateTexture() {
+    validTexture_ = false;
+}
+
+void GLState::InvalidateColor() {
+    validColor_ = false;
+}
+
+void GLState::Enable(GLenum capability) {
+    if (change(capabilities_, capabilityCount_, capability, true)) {
+        glEnable(capability);
+    }
+}
+
+void GLState::Disable(GLenum capability) {
+    if (change(capabilities_, capabilityCount_, capability, false)) {
+        glDisable(capability);
+    }
+}
+
+void GLState::EnableClientState(GLenum array) {
+    if (change(clientStates_, clientStateCount_, array, true)) {
+        glEnableClientState(array);
+    }
+}
+
+void GLState::DisableClientState(GLenum array) {
+    if (change(clientStates_, clientStateCount_, array, false)) {
+        glDisableClientState(array);
+    }
+}
+
+void GLState::LineWidth(GLfloat value) {
+    if (validLineWidth_ && lineWidth_ == value) {
+        ++skipped_;
+    } else {
+        lineWidth_ = value;
+        validLineWidth_ = true;
+        ++issued_;
+        glLineWidth(value);
+    }
+}
+
+void GLState::PointSize(GLfloat value) {
+    if (validPointSize_ && pointSize_ == value) {
+        ++skipped_;
+    } else {
+        pointSize_ = value;
+        validPointSize_ = true;
+        ++issued_;
+        glPointSize(value);
+    }
+}
+
+void GLState::BindTexture(GLuint value) {
+    if (validTexture_ && texture_ == value) {
+        ++skipped_;
+    } else {
+        texture_ = value;
+        validTexture_ = true;
+        ++issued_;
+        glBindTexture(GL_TEXTURE_2D, value);
+    }
+}
+
+void GLState::Color(const GLfloat * value) {
+    if (changeVector(color_, validColor_, value)) {
+        glColor4fv(value);
+    }
+}
+
+void GLState::Material(GLenum name, const GLfloat * value) {
+    int index = name == GL_AMBIENT ? AMBIENT_IDX : name == GL_DIFFUSE ? DIFFUSE_IDX :
+        name == GL_SPECULAR ? SPECULAR_IDX : EMISSION_IDX;
+    if (changeVector(material_[index], validMaterial_[index], value)) {
+        glMaterialfv(GL_FRONT, name, value);
+        if (index == AMBIENT_IDX || index == DIFFUSE_IDX) {
+            validColor_ = false;
+        }
+    }
+}
+
+void GLState::Material(GLenum name, GLfloat value) {
+    // Only GL_SHININESS is a single value:
+    if (validShininess_ && shininess_ == value) {
+        ++skipped_;
+    } else {
+        shininess_ = value;
+        validShininess_ = true;
+        ++issued_;
+        glMaterialf(GL_FRONT, name, value);
+    }
+}
+
+void GLState::ResetCounters() {
+    issued_ = 0;
+    skipped_ = 0;
+}
+
+//====================================================================================================
+// Types:
+//====================================================================================================
+
+struct TargaFileHeader {
+    BYTE  imageIDLength;     // ID field length (=0)
+    BYTE  colorMapType;      // = 0;
+    BYTE  imageTypeCode;     // = 2; (RGB uncompressed)
+                             // = 3; (Grayscale uncompressed)
+    INT16 colorMapOrigin;    // = 0;
+    INT16 colorMapLength;    // = 0;
+    INT16 colorMapEntrySize; // = 0;
+    INT16 imageXOrigin;      // = 0;
+    INT16 imageYOrigin;      // = 0;
+    INT16 imageWidth;        // Width in pixels of the image.
+    INT16 imageHeight;       // Height in pixels of the image.
+    BYTE  bitCount;          // Color depth (16, 24, 32)
+    BYTE  imageDescriptor;   // 24bits = 0x00, 32bits = 0x08
+};
+
+struct TargaFile {
+    BYTE   imageTypeCode;
+    INT16  imageWidth;
+    INT16  imageHeight;
+    BYTE   bitCount;
+    BYTE * imageData;
+};
+
+//====================================================================================================
+// Functions:
+//====================================================================================================
+
+unsigned char * LoadBitmapFile (const char * name, BITMAPINFOHEADER * info) {
+    // Open the file:
+    FILE * file = fopen(name, "rb");
+    if(file == nullptr) return nullptr;
+
+    // Read the header and check we have a bmp:
+    BITMAPFILEHEADER header;
+    fread(&header, sizeof(BITMAPFILEHEADER), 1, file);
+    if(header.bfType != 0x4D42) {
+        fclose(file);
+        return nullptr;
+    }
+
+    // Read another the header and check that the bmp is uncompressed:
+    fread(info, sizeof(BITMAPINFOHEADER), 1, file);
+    if(info->biCompression != BI_RGB) {
+        fclose(file);
+        return nullptr;
+    }
+
+    // Move the pointer to the section with the pixels:
+    fseek(file, header.bfOffBits, SEEK_SET);
+
+    // Ask memory for the image's buffer:
+    BYTE  colormode = info->biBitCount / 8;
+    DWORD imagesize = info->biWidth * info->biHeight * colormode;
+    unsigned char * buffer = new unsigned char[imagesize];
+    if(buffer == nullptr) {
+        fclose(file);
+        return nullptr;
+    }
+
+    // Read the contents of the image:
+    fread(buffer, 1, imagesize, file);
+
+    // Convert pixels from BGR to RGB:
+    unsigned char temprgb;
+    for(DWORD imgidx = 0; imgidx < imagesize; imgidx += 3) {
+        temprgb = buffer[imgidx];
+        buffer[imgidx] = buffer[imgidx + 2];
+        buffer[imgidx + 2] = temprgb;
+    }
 
     // Close the file and return the buffer:
     fclose(file);
@@ -600,6 +1058,7 @@ void Texture::ReleaseFromCard() {
     if (name_) {
         if (glIsTexture(name_)) {
             glDeleteTextures(1, &name_);
+            GLState::InvalidateTexture();
         }
         name_ = 0;
     }
@@ -647,7 +1106,7 @@ bool Texture::LoadIntoCard() {
         return false;
     }
     glGenTextures(1, &name_);
-    glBindTexture(GL_TEXTURE_2D, name_);
+    GLState::BindTexture(name_);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, width_, height_, format, GL_UNSIGNED_BYTE, buffer_.get());
@@ -710,63 +1169,1740 @@ void Material::SetTexture(GLuint value) {
     texture_ = value;
 }
 
+GLuint Material::GetKey() const {
+    // FNV-1a hash of the values without the texture, so equal materials share the same key:
+    const GLfloat * fields[] = { color_, ambient_, diffuse_, specular_, emission_, &shininess_ };
+    const size_t lengths[] = { ARRAY4_LENGTH, ARRAY4_LENGTH, ARRAY4_LENGTH, ARRAY4_LENGTH, ARRAY4_LENGTH, 1 };
+    GLuint hash = 2166136261u;
+    for (size_t i = 0; i < 6; ++i) {
+        const unsigned char * bytes = reinterpret_cast<const unsigned char *>(fields[i]);
+        for (size_t j = 0, size = lengths[i] * sizeof(GLfloat); j < size; ++j) {
+            hash = (hash ^ bytes[j]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
 void Material::Apply() {
-    glMaterialfv(GL_FRONT, GL_AMBIENT, ambient_);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse_);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, specular_);
-    glMaterialfv(GL_FRONT, GL_EMISSION, emission_);
-    glMaterialf(GL_FRONT, GL_SHININESS, shininess_);
-    glBindTexture(GL_TEXTURE_2D, texture_);
-    glColor4fv(color_);
+    GLState::Material(GL_AMBIENT, ambient_);
+    GLState::Material(GL_DIFFUSE, diffuse_);
+    GLState::Material(GL_SPECULAR, specular_);
+    GLState::Material(GL_EMISSION, emission_);
+    GLState::Material(GL_SHININESS, shininess_);
+    GLState::BindTexture(texture_);
+    GLState::Color(color_);
 }
 
 //****************************************************************************************************
-//******************************************** Materials *********************************************
+//********************************************* Geometry *********************************************
 //****************************************************************************************************
 
 //====================================================================================================
-// class NodeObject:
+// class GeometryBuffer:
 //====================================================================================================
 
 //----------------------------------------------------------------------------------------------------
 // Constructors:
 //----------------------------------------------------------------------------------------------------
 
-NodeObject::NodeObject() {}
-
-NodeObject::~NodeObject() {}
+GeometryBuffer::GeometryBuffer(GLenum mode) : mode_(mode) {}
 
 //----------------------------------------------------------------------------------------------------
 // Methods:
 //----------------------------------------------------------------------------------------------------
 
-Material & NodeObject::GetMaterial() {
-    return material_;
+void GeometryBuffer::BuildSphere(GLdouble radius, GLint slices, GLint stacks) {
+    // Same vertices, normals, texture coordinates and orientation as gluSphere:
+    GLfloat r = static_cast<GLfloat>(radius);
+    GLint columns = slices + 1;
+    vertices_.clear(), normals_.clear(), texcoords_.clear(), indices_.clear();
+    vertices_.reserve((stacks + 1) * columns * 3);
+    normals_.reserve((stacks + 1) * columns * 3);
+    texcoords_.reserve((stacks + 1) * columns * 2);
+    for (GLint j = 0; j <= stacks; ++j) {
+        GLfloat stackSine, stackCosine;
+        SinCos(PI * j / stacks, stackSine, stackCosine);
+        for (GLint i = 0; i <= slices; ++i) {
+            GLfloat sliceSine, sliceCosine;
+            SinCos(2.0f * PI * (i == slices ? 0 : i) / slices, sliceSine, sliceCosine);
+            GLfloat nx = stackSine * sliceSine, ny = stackSine * sliceCosine, nz = stackCosine;
+            vertices_.push_back(nx * r), vertices_.push_back(ny * r), vertices_.push_back(nz * r);
+            normals_.push_back(nx), normals_.push_back(ny), normals_.push_back(nz);
+            texcoords_.push_back(1.0f - static_cast<GLfloat>(i) / slices);
+            texcoords_.push_back(1.0f - static_cast<GLfloat>(j) / stacks);
+        }
+    }
+    // Two triangles for each quad of the strips of gluSphere (high, low, high + 1, low + 1):
+    indices_.reserve(stacks * slices * 6);
+    for (GLint j = 0; j < stacks; ++j) {
+        for (GLint i = 0; i < slices; ++i) {
+            GLuint low = j * columns + i, high = low + columns;
+            indices_.push_back(high), indices_.push_back(low), indices_.push_back(high + 1);
+            indices_.push_back(high + 1), indices_.push_back(low), indices_.push_back(low + 1);
+        }
+    }
 }
 
-void NodeObject::AddChildren(NodeObject * victim) {
-    childrens_.push_back(victim);
+void GeometryBuffer::BuildCircle(GLdouble radius, GLint slices) {
+    // Same ring as gluDisk with GLU_LINE in the XY plane, facing +Z:
+    GLfloat r = static_cast<GLfloat>(radius);
+    vertices_.clear(), normals_.clear(), texcoords_.clear(), indices_.clear();
+    for (GLint i = 0; i < slices; ++i) {
+        GLfloat sine, cosine;
+        SinCos(2.0f * PI * i / slices, sine, cosine);
+        vertices_.push_back(r * sine), vertices_.push_back(r * cosine), vertices_.push_back(0.0f);
+        normals_.push_back(0.0f), normals_.push_back(0.0f), normals_.push_back(1.0f);
+        indices_.push_back(i);
+    }
 }
 
-void NodeObject::ClearChildrens() {
-    childrens_.clear();
+void GeometryBuffer::Draw() const {
+    // The color array is disabled, because the color comes from the material. The arrays are
+    // left as they are after the draw, so the next buffer doesn't have to change them again:
+    GLState::EnableClientState(GL_NORMAL_ARRAY);
+    GLState::DisableClientState(GL_COLOR_ARRAY);
+    if (texcoords_.empty()) {
+        GLState::DisableClientState(GL_TEXTURE_COORD_ARRAY);
+    } else {
+        GLState::EnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, 0, texcoords_.data());
+    }
+    glVertexPointer(3, GL_FLOAT, 0, vertices_.data());
+    glNormalPointer(GL_FLOAT, 0, normals_.data());
+    glDrawElements(mode_, static_cast<GLsizei>(indices_.size()), GL_UNSIGNED_INT, indices_.data());
 }
 
-void NodeObject::Initialize() {
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+const int GEOMETRY_SPHERE = 0, GEOMETRY_DISK = 1;
+
+std::map<GeometryBuffer::Key, std::shared_ptr<const GeometryBuffer>> & GeometryBuffer::cache() {
+    // Built on the first use, so it can be used by global objects:
+    static std::map<Key, std::shared_ptr<const GeometryBuffer>> instance;
+    return instance;
 }
 
-void NodeObject::Draw() {
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-        material_.Apply();
-        drawChildrens();
-    glPopMatrix();
+std::shared_ptr<const GeometryBuffer> GeometryBuffer::Sphere(GLdouble radius, GLint slices, GLint stacks) {
+    auto & victim = cache()[Key(GEOMETRY_SPHERE, radius, slices, stacks)];
+    if (!victim) {
+        auto buffer = std::make_shared<GeometryBuffer>(GL_TRIANGLES);
+        buffer->BuildSphere(radius, slices, stacks);
+        victim = buffer;
+    }
+    return victim;
 }
 
-void NodeObject::drawChildrens() {
-    std::for_each(std::begin(childrens_), std::end(childrens_),
-        [] (NodeObject * victim) {
-            victim->Draw();
-        }
-    );
+std::shared_ptr<const GeometryBuffer> GeometryBuffer::Disk(GLdouble radius, GLint slices, GLint loops) {
+    // With the same inner and outer radius, all the loops of gluDisk are the same ring:
+    auto & victim = cache()[Key(GEOMETRY_DISK, radius, slices, loops)];
+    if (!victim) {
+        auto buffer = std::make_shared<GeometryBuffer>(GL_LINE_LOOP);
+        buffer->BuildCircle(radius, slices);
+        victim = buffer;
+    }
+    return victim;
+}
+
+void GeometryBuffer::ClearCache() {
+    cache().clear();
+}
+
+//====================================================================================================
+// class LevelOfDetail:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constants:
+//----------------------------------------------------------------------------------------------------
+
+const GLfloat LevelOfDetail::PIXELS_PER_EDGE = 4.0f;
+const GLfloat LevelOfDetail::HYSTERESIS = 0.2f;
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+LevelOfDetail::LevelOfDetail() : count_(0), current_(0) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void LevelOfDetail::SetChain(GLint slices, GLint minimum) {
+    count_ = 0;
+    do {
+        slices_[count_++] = slices;
+        slices /= 2;
+    } while (count_ < MAX_LEVELS && slices >= minimum);
+    current_ = 0;
+}
+
+int LevelOfDetail::Select(GLfloat pixels) {
+    // Slices needed to draw the silhouette of the figure with edges of PIXELS_PER_EDGE pixels:
+    GLfloat needed = 2.0f * PI * pixels / PIXELS_PER_EDGE;
+    // A finer level is taken as soon as it's needed:
+    while (current_ > 0 && slices_[current_] < needed) {
+        --current_;
+    }
+    // A coarser level is taken only when it's needed with a margin:
+    while (current_ + 1 < count_ && slices_[current_ + 1] * (1.0f - HYSTERESIS) >= needed) {
+        ++current_;
+    }
+    return current_;
+}
+
+//****************************************************************************************************
+//******************************************* Scene graph ********************************************
+//****************************************************************************************************
+
+//====================================================================================================
+// class NodeObject:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+NodeObject::NodeObject() : dirty_(true) {}
+
+NodeObject::~NodeObject() {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+Material & NodeObject::GetMaterial() {
+    return material_;
+}
+
+void NodeObject::AddChildren(NodeObject * victim) {
+    childrens_.push_back(victim);
+}
+
+void NodeObject::ClearChildrens() {
+    childrens_.clear();
+}
+
+void NodeObject::Initialize() {
+}
+
+void NodeObject::GetLocalMatrix(Matrix & victim) const {
+    victim.SetAsIdentity();
+}
+
+GLfloat NodeObject::GetRadius() const {
+    return 0.0f;
+}
+
+NodeObject::Pass NodeObject::GetPass() const {
+    return LIT_PASS;
+}
+
+void NodeObject::SelectDetail(GLfloat) {
+}
+
+void NodeObject::PrepareView(const SceneView &, const Matrix &) {
+}
+
+void NodeObject::SetTime(GLdouble) {
+}
+
+void NodeObject::DrawGeometry() {
+    material_.Apply();
+}
+
+void NodeObject::Draw() {
+    Matrix local;
+    GetLocalMatrix(local);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+        local.MultiplyInOpenGL();
+        drawChildrens();
+        DrawGeometry();
+    glPopMatrix();
+}
+
+void NodeObject::drawChildrens() {
+    std::for_each(std::begin(childrens_), std::end(childrens_),
+        [] (NodeObject * victim) {
+            victim->Draw();
+        }
+    );
+}
+
+//====================================================================================================
+// class FlatScene:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+FlatScene::FlatScene() : recomputed_(0), reused_(0), drawn_(0), culled_(0) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void FlatScene::Compile(NodeObject * root) {
+    Clear();
+    compile(root, NO_PARENT);
+    size_t size = objects_.size();
+    locals_.resize(size);
+    worlds_.resize(size);
+    changed_.resize(size);
+    centers_.resize(size);
+    radii_.resize(size);
+    boundCenters_.resize(size);
+    boundRadii_.resize(size);
+    boundChanged_.resize(size);
+    for (auto victim : objects_) {
+        victim->SetDirty();
+    }
+    Update();
+}
+
+void FlatScene::compile(NodeObject * victim, int parent) {
+    int index = static_cast<int>(objects_.size());
+    objects_.push_back(victim);
+    parents_.push_back(parent);
+    ends_.push_back(0);
+    for (auto children : victim->GetChildrens()) {
+        compile(children, index);
+    }
+    ends_[index] = objects_.size();
+}
+
+void FlatScene::Clear() {
+    objects_.clear();
+    parents_.clear();
+    ends_.clear();
+    locals_.clear();
+    worlds_.clear();
+    changed_.clear();
+    centers_.clear();
+    radii_.clear();
+    boundCenters_.clear();
+    boundRadii_.clear();
+    boundChanged_.clear();
+    recomputed_ = 0;
+    reused_ = 0;
+    drawn_ = 0;
+    culled_ = 0;
+}
+
+void FlatScene::Update() {
+    // The parent is always updated before its childrens, so a changed parent is already known:
+    recomputed_ = 0;
+    reused_ = 0;
+    for (size_t i = 0, size = objects_.size(); i < size; ++i) {
+        NodeObject * victim = objects_[i];
+        int parent = parents_[i];
+        bool parentChanged = parent != NO_PARENT && changed_[parent];
+        if (victim->IsDirty()) {
+            victim->GetLocalMatrix(locals_[i]);
+            victim->ClearDirty();
+        } else if (!parentChanged) {
+            changed_[i] = false;
+            ++reused_;
+            continue;
+        }
+        if (parent == NO_PARENT) {
+            worlds_[i] = locals_[i];
+        } else {
+            worlds_[i] = worlds_[parent] * locals_[i];
+        }
+        changed_[i] = true;
+        ++recomputed_;
+    }
+    updateBounds();
+}
+
+static GLfloat MaxScale(const Matrix & victim) {
+    // Largest scale of the 3x3 part, to transform a radius:
+    GLfloat result = 0.0f;
+    for (int j = 0; j < 3; ++j) {
+        GLfloat x = victim.Get(0, j), y = victim.Get(1, j), z = victim.Get(2, j);
+        GLfloat length = x * x + y * y + z * z;
+        result = length > result ? length : result;
+    }
+    return std::sqrt(result);
+}
+
+static void MergeSpheres(Point3 & center, GLfloat & radius, const Point3 & otherCenter, GLfloat otherRadius) {
+    // Smallest sphere that contains both spheres:
+    Vector3 offset = Vector3(otherCenter) - Vector3(center);
+    GLfloat distance = offset.Length();
+    if (distance + otherRadius <= radius) {
+        return;
+    } else if (distance + radius <= otherRadius) {
+        center = otherCenter;
+        radius = otherRadius;
+    } else {
+        GLfloat merged = (distance + radius + otherRadius) * 0.5f;
+        center.AddScaled(offset, (merged - radius) / distance);
+        radius = merged;
+    }
+}
+
+void FlatScene::updateBounds() {
+    // The childrens are always after their parent, so the subtrees are merged backwards. The children
+    // of a node are the nodes from index + 1 to the end of its subtree, jumping over their own subtrees:
+    for (size_t i = objects_.size(); i-- > 0;) {
+        bool refresh = changed_[i];
+        for (size_t j = i + 1; j < ends_[i] && !refresh; j = ends_[j]) {
+            refresh = boundChanged_[j];
+        }
+        if (refresh) {
+            const Matrix & world = worlds_[i];
+            centers_[i].Set(world.Get(0, 3), world.Get(1, 3), world.Get(2, 3));
+            radii_[i] = objects_[i]->GetRadius() * MaxScale(world);
+            Point3 center = centers_[i];
+            GLfloat radius = radii_[i];
+            for (size_t j = i + 1; j < ends_[i]; j = ends_[j]) {
+                MergeSpheres(center, radius, boundCenters_[j], boundRadii_[j]);
+            }
+            boundCenters_[i] = center;
+            boundRadii_[i] = radius;
+        }
+        boundChanged_[i] = refresh;
+    }
+}
+
+void FlatScene::SetTime(GLdouble seconds) {
+    // Every node only depends on the time, so they can be updated in any order:
+    for (NodeObject * victim : objects_) {
+        victim->SetTime(seconds);
+    }
+}
+
+void FlatScene::Draw() {
+    // The world matrices are relative to the current modelview matrix (the camera):
+    glMatrixMode(GL_MODELVIEW);
+    for (size_t i = 0, size = objects_.size(); i < size; ++i) {
+        drawNode(i);
+    }
+    drawn_ = objects_.size();
+    culled_ = 0;
+}
+
+void FlatScene::Draw(const SceneView & view) {
+    // The view must use the same camera as the current modelview matrix:
+    Prepare(view);
+    Submit();
+}
+
+void FlatScene::Prepare(const SceneView & view) {
+    // Culls, selects the details and sorts once, the queue can be submitted many times:
+    queue_.Clear();
+    Collect(view, queue_);
+    queue_.Sort();
+}
+
+void FlatScene::Submit() const {
+    queue_.Submit(*this);
+}
+
+void FlatScene::Collect(const SceneView & view, RenderQueue & queue) {
+    const Frustum & frustum = view.GetFrustum();
+    drawn_ = 0;
+    culled_ = 0;
+    for (size_t i = 0, size = objects_.size(); i < size;) {
+        size_t end = ends_[i];
+        Frustum::Result result = frustum.Test(boundCenters_[i], boundRadii_[i]);
+        if (result == Frustum::OUTSIDE) {
+            // The whole subtree is rejected:
+            culled_ += end - i;
+            i = end;
+        } else if (result == Frustum::INSIDE) {
+            // The whole subtree is drawn without more tests:
+            drawn_ += end - i;
+            for (; i < end; ++i) {
+                collectNode(i, view, queue);
+            }
+        } else {
+            if (frustum.Test(centers_[i], radii_[i]) != Frustum::OUTSIDE) {
+                collectNode(i, view, queue);
+                ++drawn_;
+            } else {
+                ++culled_;
+            }
+            ++i;
+        }
+    }
+}
+
+void FlatScene::drawNode(size_t index) {
+    glPushMatrix();
+        worlds_[index].MultiplyInOpenGL();
+        objects_[index]->DrawGeometry();
+    glPopMatrix();
+}
+
+void FlatScene::collectNode(size_t index, const SceneView & view, RenderQueue & queue) {
+    objects_[index]->SelectDetail(view.ScreenRadius(centers_[index], radii_[index]));
+    objects_[index]->PrepareView(view, worlds_[index]);
+    queue.Push(objects_[index], static_cast<GLuint>(index));
+}
+
+//====================================================================================================
+// class CommandList:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+CommandList::CommandList() : name_(0) {}
+
+CommandList::~CommandList() {
+    Release();
+}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void CommandList::Begin() {
+    // The name is generated with the first recording, when the context already exists:
+    if (!name_) {
+        name_ = glGenLists(1);
+    }
+    GLState::Invalidate();
+    glNewList(name_, GL_COMPILE);
+}
+
+void CommandList::End() {
+    glEndList();
+    GLState::Invalidate();
+}
+
+void CommandList::Call() const {
+    // The list changes the state behind GLState, so it's unknown after the call:
+    if (name_) {
+        glCallList(name_);
+        GLState::Invalidate();
+    }
+}
+
+void CommandList::Release() {
+    if (name_) {
+        glDeleteLists(name_, 1);
+        name_ = 0;
+    }
+}
+
+//====================================================================================================
+// class RenderQueue:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+RenderQueue::RenderQueue() : packets_() {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void RenderQueue::Clear() {
+    packets_.clear();
+}
+
+void RenderQueue::Push(NodeObject * geometry, GLuint transform) {
+    const Material & material = geometry->GetMaterial();
+    Packet victim;
+    victim.key = MakeKey(geometry->GetPass(), material.GetKey(), material.GetTexture(), transform);
+    victim.transform = transform;
+    victim.geometry = geometry;
+    packets_.push_back(victim);
+}
+
+void RenderQueue::Sort() {
+    std::sort(packets_.begin(), packets_.end(), [] (const Packet & a, const Packet & b) {
+        return a.key < b.key;
+    });
+}
+
+void RenderQueue::Submit(const FlatScene & scene) const {
+    // The world matrices are relative to the current modelview matrix (the camera):
+    glMatrixMode(GL_MODELVIEW);
+    for (const Packet & packet : packets_) {
+        glPushMatrix();
+            scene.GetWorld(packet.transform).MultiplyInOpenGL();
+            packet.geometry->DrawGeometry();
+        glPopMatrix();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+uint64_t RenderQueue::MakeKey(GLuint pass, GLuint material, GLuint texture, GLuint index) {
+    // The values are cut to their fields, from the highest bits to the lowest ones:
+    const uint64_t one = 1;
+    uint64_t key = pass & ((one << PASS_BITS) - 1);
+    key = (key << MATERIAL_BITS) | (material & ((one << MATERIAL_BITS) - 1));
+    key = (key << TEXTURE_BITS) | (texture & ((one << TEXTURE_BITS) - 1));
+    key = (key << INDEX_BITS) | (index & ((one << INDEX_BITS) - 1));
+    return key;
+}
+
+//****************************************************************************************************
+//******************************************** Simulation ********************************************
+//****************************************************************************************************
+
+//====================================================================================================
+// class AngularMotion:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+AngularMotion::AngularMotion() : rate_(0.0), phase_(0.0) {}
+
+AngularMotion::AngularMotion(GLdouble rate, GLdouble phase) : rate_(rate), phase_(phase) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+GLdouble AngularMotion::GetPeriod() const {
+    return rate_ != 0.0 ? 360.0 / std::fabs(rate_) : 0.0;
+}
+
+GLdouble AngularMotion::At(GLdouble seconds) const {
+    // The angle is kept in [0, 360) for negative times too:
+    GLdouble angle = std::fmod(phase_ + rate_ * seconds, 360.0);
+    return angle < 0.0 ? angle + 360.0 : angle;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+AngularMotion AngularMotion::FromPeriod(GLdouble period, GLdouble phase) {
+    return AngularMotion(360.0 / period, phase);
+}
+
+//====================================================================================================
+// class SimulationClock:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+SimulationClock::SimulationClock(GLdouble tickRate, int maxSteps) : tickSeconds_(1.0 / tickRate),
+    accumulator_(0.0), lastTime_(0.0), windowStart_(0.0), measuredRate_(0.0), maxSteps_(maxSteps),
+    steps_(0), windowTicks_(0), ticks_(0) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void SimulationClock::SetTickRate(GLdouble value) {
+    // The fraction of the current tick is kept, so the interpolation doesn't jump:
+    GLdouble alpha = GetAlpha();
+    tickSeconds_ = 1.0 / value;
+    accumulator_ = alpha * tickSeconds_;
+}
+
+void SimulationClock::SetMaxSteps(int value) {
+    maxSteps_ = value;
+}
+
+void SimulationClock::Reset(GLdouble seconds) {
+    accumulator_ = 0.0;
+    lastTime_ = seconds;
+    windowStart_ = seconds;
+    measuredRate_ = 0.0;
+    steps_ = 0;
+    windowTicks_ = 0;
+}
+
+int SimulationClock::Advance(GLdouble seconds) {
+    // Consume the elapsed time in whole ticks:
+    accumulator_ += seconds - lastTime_;
+    lastTime_ = seconds;
+    steps_ = 0;
+    while (accumulator_ >= tickSeconds_) {
+        accumulator_ -= tickSeconds_;
+        ++steps_;
+    }
+    if (steps_ > maxSteps_) {
+        steps_ = maxSteps_;
+    }
+    ticks_ += steps_;
+
+    // Measure the real rate of ticks every second:
+    windowTicks_ += steps_;
+    if (seconds - windowStart_ >= 1.0) {
+        measuredRate_ = windowTicks_ / (seconds - windowStart_);
+        windowStart_ = seconds;
+        windowTicks_ = 0;
+    }
+    return steps_;
+}
+
+//====================================================================================================
+// struct KeplerOrbit:
+//====================================================================================================
+
+void KeplerOrbit::Position(GLdouble seconds, GLfloat * position) const {
+    const GLdouble RADIANS = 3.14159265358979323846 / 180.0;
+    // Mean anomaly, and the eccentric anomaly that solves M = E - e sin(E):
+    GLdouble mean = (phase + 360.0 * seconds / period) * RADIANS;
+    GLdouble anomaly = mean;
+    for (int i = 0; i < 8; ++i) {
+        anomaly -= (anomaly - eccentricity * std::sin(anomaly) - mean) / (1.0 - eccentricity * std::cos(anomaly));
+    }
+    // Position in the XZ plane, with the same direction of the circular orbits:
+    GLdouble minor = semiMajor * std::sqrt(1.0 - eccentricity * eccentricity);
+    GLdouble x = semiMajor * (std::cos(anomaly) - eccentricity), z = -minor * std::sin(anomaly);
+    GLdouble sw = std::sin(periapsis * RADIANS), cw = std::cos(periapsis * RADIANS);
+    GLdouble si = std::sin(inclination * RADIANS), ci = std::cos(inclination * RADIANS);
+    GLdouble px = cw * x + sw * z, pz = cw * z - sw * x;
+    position[0] = static_cast<GLfloat>(px);
+    position[1] = static_cast<GLfloat>(-pz * si);
+    position[2] = static_cast<GLfloat>(pz * ci);
+}
+
+//====================================================================================================
+// class Ephemeris:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constants:
+//----------------------------------------------------------------------------------------------------
+
+const int Ephemeris::MAX_COEFFICIENTS;
+const int Ephemeris::LANES;
+
+static const char EPHEMERIS_MAGIC[4] = { 'G', 'E', 'P', 'H' };
+static const GLuint EPHEMERIS_VERSION = 1;
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+Ephemeris::Ephemeris() : bodies_(0), segments_(0), coefficients_(0), duration_(0.0), span_(0.0) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+const GLfloat * Ephemeris::locate(GLdouble seconds, GLfloat & x) const {
+    // Find the segment of the time, and its position inside it from -1 to 1:
+    GLdouble time = std::fmod(seconds, duration_);
+    if (time < 0.0) time += duration_;
+    size_t segment = static_cast<size_t>(time / span_);
+    segment = segment < segments_ ? segment : segments_ - 1;
+    x = static_cast<GLfloat>(2.0 * (time - segment * span_) / span_ - 1.0);
+    return &table_[segment * bodies_ * coefficients_ * LANES];
+}
+
+void Ephemeris::clenshaw(const GLfloat * series, int count, GLfloat x, GLfloat * position) {
+    // b(k) = 2x b(k+1) - b(k+2) + c(k), and the value is x b(1) - b(2) + c(0):
+#ifdef GSYSTEM_SSE
+    __m128 x2 = _mm_set1_ps(2.0f * x), b1 = _mm_setzero_ps(), b2 = _mm_setzero_ps();
+    for (int k = count - 1; k >= 1; --k) {
+        __m128 b0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(x2, b1), b2), _mm_loadu_ps(series + k * LANES));
+        b2 = b1;
+        b1 = b0;
+    }
+    __m128 result = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(x), b1), b2), _mm_loadu_ps(series));
+    _mm_storeu_ps(position, result);
+#else
+    clenshawScalar(series, count, x, position);
+#endif
+}
+
+void Ephemeris::clenshawScalar(const GLfloat * series, int count, GLfloat x, GLfloat * position) {
+    GLfloat b1[LANES] = { 0.0f, 0.0f, 0.0f, 0.0f }, b2[LANES] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int k = count - 1; k >= 1; --k) {
+        for (int j = 0; j < LANES; ++j) {
+            GLfloat b0 = 2.0f * x * b1[j] - b2[j] + series[k * LANES + j];
+            b2[j] = b1[j];
+            b1[j] = b0;
+        }
+    }
+    for (int j = 0; j < LANES; ++j) {
+        position[j] = x * b1[j] - b2[j] + series[j];
+    }
+}
+
+GLdouble Ephemeris::CommonPeriod(const GLdouble * periods, size_t count, int maxTurns) {
+    // The shortest multiple of the longest period that is a whole number of every other period, or 0
+    // when there isn't one in maxTurns turns:
+    GLdouble longest = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        longest = periods[i] > longest ? periods[i] : longest;
+    }
+    if (longest <= 0.0) return 0.0;
+    for (int turn = 1; turn <= maxTurns; ++turn) {
+        GLdouble duration = longest * turn;
+        bool common = true;
+        for (size_t i = 0; i < count && common; ++i) {
+            GLdouble cycles = duration / periods[i];
+            common = std::fabs(cycles - std::floor(cycles + 0.5)) <= 1e-9 * cycles;
+        }
+        if (common) return duration;
+    }
+    return 0.0;
+}
+
+void Ephemeris::Fit(size_t bodies, GLdouble duration, size_t segments, int coefficients, const Model & model) {
+    // The coefficients are taken from the values at the Chebyshev nodes of each segment:
+    const GLdouble PI_D = 3.14159265358979323846;
+    coefficients = coefficients < MAX_COEFFICIENTS ? coefficients : MAX_COEFFICIENTS;
+    bodies_ = bodies;
+    segments_ = segments;
+    coefficients_ = coefficients;
+    duration_ = duration;
+    span_ = duration / segments;
+    table_.assign(segments * bodies * coefficients * LANES, 0.0f);
+    std::vector<GLdouble> values(coefficients * 3);
+    for (size_t s = 0; s < segments; ++s) {
+        GLdouble middle = (s + 0.5) * span_, half = 0.5 * span_;
+        for (size_t b = 0; b < bodies; ++b) {
+            for (int j = 0; j < coefficients; ++j) {
+                GLfloat position[3];
+                model(b, middle + half * std::cos(PI_D * (j + 0.5) / coefficients), position);
+                for (int a = 0; a < 3; ++a) {
+                    values[j * 3 + a] = position[a];
+                }
+            }
+            GLfloat * series = &table_[(s * bodies + b) * coefficients * LANES];
+            for (int k = 0; k < coefficients; ++k) {
+                GLdouble sums[3] = { 0.0, 0.0, 0.0 };
+                for (int j = 0; j < coefficients; ++j) {
+                    GLdouble weight = std::cos(PI_D * k * (j + 0.5) / coefficients);
+                    for (int a = 0; a < 3; ++a) {
+                        sums[a] += values[j * 3 + a] * weight;
+                    }
+                }
+                // The first coefficient is halved, so the evaluation doesn't need a special case:
+                GLdouble scale = (k ? 2.0 : 1.0) / coefficients;
+                for (int a = 0; a < 3; ++a) {
+                    series[k * LANES + a] = static_cast<GLfloat>(sums[a] * scale);
+                }
+            }
+        }
+    }
+}
+
+void Ephemeris::Evaluate(size_t body, GLdouble seconds, GLfloat * position) const {
+    // The position has 4 floats, the last one is always 0:
+    GLfloat x;
+    const GLfloat * segment = locate(seconds, x);
+    clenshaw(segment + body * coefficients_ * LANES, coefficients_, x, position);
+}
+
+void Ephemeris::Evaluate(GLdouble seconds, GLfloat * positions) const {
+    // Every body uses the same segment, and the series are stored one after another:
+    GLfloat x;
+    const GLfloat * segment = locate(seconds, x);
+    for (size_t b = 0; b < bodies_; ++b) {
+        clenshaw(segment + b * coefficients_ * LANES, coefficients_, x, positions + b * LANES);
+    }
+}
+
+void Ephemeris::EvaluateScalar(size_t body, GLdouble seconds, GLfloat * position) const {
+    GLfloat x;
+    const GLfloat * segment = locate(seconds, x);
+    clenshawScalar(segment + body * coefficients_ * LANES, coefficients_, x, position);
+}
+
+bool Ephemeris::Load(const char * path) {
+    FILE * file = fopen(path, "rb");
+    if (!file) return false;
+    // The size of the table must match the size of the file before anything is allocated:
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+    }
+    Header header;
+    bool result = length >= static_cast<long>(sizeof(Header)) && fseek(file, 0, SEEK_SET) == 0 &&
+        fread(&header, sizeof(Header), 1, file) == 1 &&
+        memcmp(header.magic, EPHEMERIS_MAGIC, sizeof(EPHEMERIS_MAGIC)) == 0 &&
+        header.version == EPHEMERIS_VERSION && header.bodies > 0 && header.segments > 0 &&
+        header.duration > 0.0 && header.coefficients > 0 &&
+        header.coefficients <= static_cast<GLuint>(MAX_COEFFICIENTS);
+    if (result) {
+        const uint64_t SERIES = static_cast<uint64_t>(header.coefficients) * LANES * sizeof(GLfloat);
+        uint64_t bytes = static_cast<uint64_t>(length) - sizeof(Header);
+        result = bytes % SERIES == 0 && bytes / SERIES == static_cast<uint64_t>(header.segments) * header.bodies;
+    }
+    if (result) {
+        std::vector<GLfloat> table(static_cast<size_t>(header.segments) * header.bodies * header.coefficients * LANES);
+        result = fread(table.data(), sizeof(GLfloat), table.size(), file) == table.size();
+        if (result) {
+            bodies_ = header.bodies;
+            segments_ = header.segments;
+            coefficients_ = header.coefficients;
+            duration_ = header.duration;
+            span_ = duration_ / segments_;
+            table_.swap(table);
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+bool Ephemeris::Save(const char * path) const {
+    FILE * file = fopen(path, "wb");
+    if (!file) return false;
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, EPHEMERIS_MAGIC, sizeof(EPHEMERIS_MAGIC));
+    header.version = EPHEMERIS_VERSION;
+    header.bodies = static_cast<GLuint>(bodies_);
+    header.segments = static_cast<GLuint>(segments_);
+    header.coefficients = static_cast<GLuint>(coefficients_);
+    header.duration = duration_;
+    bool result = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+        fwrite(table_.data(), sizeof(GLfloat), table_.size(), file) == table_.size();
+    fclose(file);
+    return result;
+}
+
+void Ephemeris::Clear() {
+    bodies_ = 0;
+    segments_ = 0;
+    coefficients_ = 0;
+    duration_ = 0.0;
+    span_ = 0.0;
+    table_.clear();
+}
+
+//****************************************************************************************************
+//******************************************** Parallelism *******************************************
+//****************************************************************************************************
+
+//====================================================================================================
+// class ThreadPool:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(unsigned int threads) : body_(nullptr), count_(0), chunk_(0), next_(0),
+    pending_(0), generation_(0), stop_(false) {
+    // By default there is a worker for each hardware thread but the calling one:
+    if (!threads) {
+        threads = std::thread::hardware_concurrency();
+    }
+    for (unsigned int i = 1; i < threads; ++i) {
+        workers_.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (auto & worker : workers_) {
+        worker.join();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void ThreadPool::work() {
+    size_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&] { return stop_ || generation_ != generation; });
+            if (stop_) return;
+            generation = generation_;
+        }
+        runChunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::runChunks() {
+    for (size_t begin = next_.fetch_add(chunk_); begin < count_; begin = next_.fetch_add(chunk_)) {
+        size_t end = count_ - begin > chunk_ ? begin + chunk_ : count_;
+        (*body_)(begin, end);
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const Body & body) {
+    if (workers_.empty() || count <= grain) {
+        body(0, count);
+        return;
+    }
+    {
+        // A few chunks per thread, to balance the work when some threads are slower:
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t chunk = (count + Size() * 4 - 1) / (Size() * 4);
+        body_ = &body;
+        count_ = count;
+        chunk_ = chunk > grain ? chunk : grain;
+        next_ = 0;
+        pending_ = workers_.size();
+        ++generation_;
+    }
+    start_.notify_all();
+    runChunks();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return pending_ == 0; });
+}
+
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+ThreadPool & ThreadPool::Shared() {
+    // Built on the first use, so it can be used by global objects:
+    static ThreadPool instance;
+    return instance;
+}
+
+//****************************************************************************************************
+//********************************************** Physics *********************************************
+//****************************************************************************************************
+
+//====================================================================================================
+// class GravitySystem:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constants:
+//----------------------------------------------------------------------------------------------------
+
+const int GravitySystem::LEAF_BODIES;
+const int GravitySystem::MAX_DEPTH;
+
+static inline uint64_t SpreadBits(uint64_t value) {
+    // Puts two zeros between the 21 lower bits of the value:
+    value &= 0x1fffff;
+    value = (value | value << 32) & 0x1f00000000ffffULL;
+    value = (value | value << 16) & 0x1f0000ff0000ffULL;
+    value = (value | value << 8) & 0x100f00f00f00f00fULL;
+    value = (value | value << 4) & 0x10c30c30c30c30c3ULL;
+    value = (value | value << 2) & 0x1249249249249249ULL;
+    return value;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+GravitySystem::GravitySystem() : constant_(1.0f), theta_(0.7f), softening_(0.5f), lost_(0), ready_(false) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void GravitySystem::removeInvalid(ThreadPool & pool) {
+    // The lost bodies are counted by chunks, and added without a shared counter:
+    std::vector<size_t> counts((masses_.size() + 4095) / 4096, 0);
+    pool.ParallelFor(masses_.size(), 4096, [&] (size_t begin, size_t end) {
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            if (std::isfinite(px_[i]) && std::isfinite(py_[i]) && std::isfinite(pz_[i]) &&
+                std::isfinite(vx_[i]) && std::isfinite(vy_[i]) && std::isfinite(vz_[i])) continue;
+            px_[i] = py_[i] = pz_[i] = 0.0f;
+            vx_[i] = vy_[i] = vz_[i] = 0.0f;
+            masses_[i] = 0.0f;
+            ++count;
+        }
+        counts[begin / 4096] += count;
+    });
+    for (auto count : counts) {
+        lost_ += count;
+    }
+}
+
+void GravitySystem::buildCell(GLuint index, size_t begin, size_t end, int depth, GLfloat size) {
+    // The bodies of a cell are a range of the sorted ones, and its octants are the next 3 bits of
+    // their codes, so the children are contiguous ranges too:
+    GLuint first = static_cast<GLuint>(begin), children = 0;
+    if (end - begin > static_cast<size_t>(LEAF_BODIES) && depth < MAX_DEPTH) {
+        int shift = 3 * (MAX_DEPTH - 1 - depth);
+        size_t bounds[9];
+        bounds[0] = begin;
+        for (int octant = 0; octant < 8; ++octant) {
+            size_t i = bounds[octant];
+            while (i < end && static_cast<int>((keys_[i].first >> shift) & 7) == octant) ++i;
+            bounds[octant + 1] = i;
+            children += i > bounds[octant] ? 1 : 0;
+        }
+        first = static_cast<GLuint>(cells_.size());
+        cells_.resize(cells_.size() + children);
+        GLuint child = first;
+        for (int octant = 0; octant < 8; ++octant) {
+            if (bounds[octant + 1] > bounds[octant]) {
+                buildCell(child++, bounds[octant], bounds[octant + 1], depth + 1, size * 0.5f);
+            }
+        }
+    }
+    // The center of mass, from the bodies of a leaf or from the children:
+    GLdouble x = 0.0, y = 0.0, z = 0.0, mass = 0.0;
+    if (children) {
+        for (GLuint i = first; i < first + children; ++i) {
+            const Cell & cell = cells_[i];
+            x += cell.x * cell.mass;
+            y += cell.y * cell.mass;
+            z += cell.z * cell.mass;
+            mass += cell.mass;
+        }
+    } else {
+        for (size_t i = begin; i < end; ++i) {
+            const GLfloat * body = &sorted_[i * 4];
+            x += body[0] * body[3];
+            y += body[1] * body[3];
+            z += body[2] * body[3];
+            mass += body[3];
+        }
+    }
+    Cell & cell = cells_[index];
+    GLdouble inverse = mass > 0.0 ? 1.0 / mass : 0.0;
+    cell.x = static_cast<GLfloat>(x * inverse);
+    cell.y = static_cast<GLfloat>(y * inverse);
+    cell.z = static_cast<GLfloat>(z * inverse);
+    cell.mass = static_cast<GLfloat>(mass);
+    cell.size = size;
+    cell.first = first;
+    cell.count = static_cast<GLuint>(end - begin);
+    cell.children = children;
+}
+
+void GravitySystem::accelerate(size_t begin, size_t end) {
+    // Every pop pushes at most 8 cells, one level deeper, so the stack has a fixed size:
+    GLuint stack[8 * (MAX_DEPTH + 1)];
+    GLfloat theta2 = theta_ * theta_, softening2 = softening_ * softening_;
+    for (size_t s = begin; s < end; ++s) {
+        const GLfloat * body = &sorted_[s * 4];
+        GLfloat x = body[0], y = body[1], z = body[2], ax = 0.0f, ay = 0.0f, az = 0.0f;
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Cell & cell = cells_[stack[--top]];
+            GLfloat dx = cell.x - x, dy = cell.y - y, dz = cell.z - z;
+            GLfloat distance2 = dx * dx + dy * dy + dz * dz;
+            if (!cell.children) {
+                // The bodies of a leaf are added one by one, the softening cancels the body itself:
+                const GLfloat * other = &sorted_[cell.first * 4];
+                for (GLuint i = 0; i < cell.count; ++i, other += 4) {
+                    GLfloat ex = other[0] - x, ey = other[1] - y, ez = other[2] - z;
+                    GLfloat inverse = 1.0f / std::sqrt(ex * ex + ey * ey + ez * ez + softening2);
+                    GLfloat factor = other[3] * inverse * inverse * inverse;
+                    ax += ex * factor;
+                    ay += ey * factor;
+                    az += ez * factor;
+                }
+            } else if (cell.size * cell.size < theta2 * distance2) {
+                GLfloat inverse = 1.0f / std::sqrt(distance2 + softening2);
+                GLfloat factor = cell.mass * inverse * inverse * inverse;
+                ax += dx * factor;
+                ay += dy * factor;
+                az += dz * factor;
+            } else {
+                for (GLuint i = 0; i < cell.children; ++i) {
+                    stack[top++] = cell.first + i;
+                }
+            }
+        }
+        GLuint index = keys_[s].second;
+        ax_[index] = ax * constant_;
+        ay_[index] = ay * constant_;
+        az_[index] = az * constant_;
+    }
+}
+
+void GravitySystem::computeAccelerations(ThreadPool & pool) {
+    size_t size = masses_.size();
+    ready_ = true;
+    if (!size) return;
+    removeInvalid(pool);
+
+    // Cube around all the bodies:
+    GLfloat low[3] = { px_[0], py_[0], pz_[0] }, high[3] = { px_[0], py_[0], pz_[0] };
+    for (size_t i = 1; i < size; ++i) {
+        const GLfloat position[3] = { px_[i], py_[i], pz_[i] };
+        for (int a = 0; a < 3; ++a) {
+            low[a] = position[a] < low[a] ? position[a] : low[a];
+            high[a] = position[a] > high[a] ? position[a] : high[a];
+        }
+    }
+    GLfloat side = 0.0f;
+    for (int a = 0; a < 3; ++a) {
+        side = high[a] - low[a] > side ? high[a] - low[a] : side;
+    }
+    side = side > 0.0f ? side * 1.0001f : 1.0f;
+
+    // Morton codes, sorted from the previous order, that is almost sorted when the steps are small:
+    if (keys_.size() != size) {
+        keys_.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            keys_[i].second = static_cast<GLuint>(i);
+        }
+    }
+    // The cells are clamped, the side may overflow with positions that are finite but huge:
+    GLfloat scale = static_cast<GLfloat>(1 << MAX_DEPTH) / side, limit = static_cast<GLfloat>((1 << MAX_DEPTH) - 1);
+    pool.ParallelFor(size, 4096, [&] (size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            GLuint i = keys_[s].second;
+            uint64_t cell[3];
+            const GLfloat offsets[3] = { px_[i] - low[0], py_[i] - low[1], pz_[i] - low[2] };
+            for (int a = 0; a < 3; ++a) {
+                GLfloat value = offsets[a] * scale;
+                value = value > 0.0f ? value : 0.0f;
+                cell[a] = static_cast<uint64_t>(value < limit ? value : limit);
+            }
+            keys_[s].first = SpreadBits(cell[0]) << 2 | SpreadBits(cell[1]) << 1 | SpreadBits(cell[2]);
+        }
+    });
+    std::sort(keys_.begin(), keys_.end());
+    sorted_.resize(size * 4);
+    pool.ParallelFor(size, 4096, [&] (size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            GLuint i = keys_[s].second;
+            GLfloat * body = &sorted_[s * 4];
+            body[0] = px_[i];
+            body[1] = py_[i];
+            body[2] = pz_[i];
+            body[3] = masses_[i];
+        }
+    });
+
+    // Octree and forces:
+    cells_.clear();
+    cells_.resize(1);
+    buildCell(0, 0, size, 0, side);
+    pool.ParallelFor(size, 64, [&] (size_t begin, size_t end) {
+        accelerate(begin, end);
+    });
+}
+
+void GravitySystem::SetConstant(GLfloat value) {
+    constant_ = value;
+    ready_ = false;
+}
+
+void GravitySystem::SetTheta(GLfloat value) {
+    theta_ = value;
+    ready_ = false;
+}
+
+void GravitySystem::SetSoftening(GLfloat value) {
+    softening_ = value;
+    ready_ = false;
+}
+
+size_t GravitySystem::Add(const GLfloat * position, const GLfloat * velocity, GLfloat mass) {
+    px_.push_back(position[0]);
+    py_.push_back(position[1]);
+    pz_.push_back(position[2]);
+    vx_.push_back(velocity[0]);
+    vy_.push_back(velocity[1]);
+    vz_.push_back(velocity[2]);
+    ax_.push_back(0.0f);
+    ay_.push_back(0.0f);
+    az_.push_back(0.0f);
+    masses_.push_back(mass);
+    ready_ = false;
+    return masses_.size() - 1;
+}
+
+void GravitySystem::GetPosition(size_t body, GLfloat * position) const {
+    position[0] = px_[body];
+    position[1] = py_[body];
+    position[2] = pz_[body];
+}
+
+void GravitySystem::GetVelocity(size_t body, GLfloat * velocity) const {
+    velocity[0] = vx_[body];
+    velocity[1] = vy_[body];
+    velocity[2] = vz_[body];
+}
+
+void GravitySystem::GetAcceleration(size_t body, GLfloat * acceleration, ThreadPool & pool) {
+    if (!ready_) computeAccelerations(pool);
+    acceleration[0] = ax_[body];
+    acceleration[1] = ay_[body];
+    acceleration[2] = az_[body];
+}
+
+void GravitySystem::Step(GLfloat seconds, ThreadPool & pool) {
+    // Half a kick, a drift, the new forces and the other half of the kick. The accelerations of
+    // the end of a step are kept for the start of the next one:
+    if (!ready_) computeAccelerations(pool);
+    GLfloat half = seconds * 0.5f;
+    pool.ParallelFor(masses_.size(), 4096, [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            vx_[i] += ax_[i] * half;
+            vy_[i] += ay_[i] * half;
+            vz_[i] += az_[i] * half;
+            px_[i] += vx_[i] * seconds;
+            py_[i] += vy_[i] * seconds;
+            pz_[i] += vz_[i] * seconds;
+        }
+    });
+    computeAccelerations(pool);
+    pool.ParallelFor(masses_.size(), 4096, [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            vx_[i] += ax_[i] * half;
+            vy_[i] += ay_[i] * half;
+            vz_[i] += az_[i] * half;
+        }
+    });
+}
+
+void GravitySystem::ZeroMomentum() {
+    // Removes the velocity of the center of mass, so the whole system doesn't drift:
+    GLdouble x = 0.0, y = 0.0, z = 0.0, mass = 0.0;
+    for (size_t i = 0, size = masses_.size(); i < size; ++i) {
+        x += vx_[i] * masses_[i];
+        y += vy_[i] * masses_[i];
+        z += vz_[i] * masses_[i];
+        mass += masses_[i];
+    }
+    if (mass <= 0.0) return;
+    for (size_t i = 0, size = masses_.size(); i < size; ++i) {
+        vx_[i] -= static_cast<GLfloat>(x / mass);
+        vy_[i] -= static_cast<GLfloat>(y / mass);
+        vz_[i] -= static_cast<GLfloat>(z / mass);
+    }
+}
+
+GLdouble GravitySystem::Energy() const {
+    // Kinetic and potential energy with all the pairs, it's meant for small systems:
+    GLdouble kinetic = 0.0, potential = 0.0, softening2 = softening_ * softening_;
+    for (size_t i = 0, size = masses_.size(); i < size; ++i) {
+        kinetic += 0.5 * masses_[i] * (vx_[i] * vx_[i] + vy_[i] * vy_[i] + vz_[i] * vz_[i]);
+        for (size_t j = i + 1; j < size; ++j) {
+            GLdouble dx = px_[j] - px_[i], dy = py_[j] - py_[i], dz = pz_[j] - pz_[i];
+            potential -= masses_[i] * masses_[j] / std::sqrt(dx * dx + dy * dy + dz * dz + softening2);
+        }
+    }
+    return kinetic + constant_ * potential;
+}
+
+void GravitySystem::Clear() {
+    px_.clear();
+    py_.clear();
+    pz_.clear();
+    vx_.clear();
+    vy_.clear();
+    vz_.clear();
+    ax_.clear();
+    ay_.clear();
+    az_.clear();
+    masses_.clear();
+    keys_.clear();
+    sorted_.clear();
+    cells_.clear();
+    lost_ = 0;
+    ready_ = false;
+}
+
+//****************************************************************************************************
+//************************************************ Sky ***********************************************
+//****************************************************************************************************
+
+//====================================================================================================
+// class MappedFile:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+MappedFile::MappedFile() : data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr) {}
+#else
+MappedFile::MappedFile() : data_(nullptr), size_(0), file_(-1) {}
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+bool MappedFile::Open(const char * path) {
+    Close();
+#ifdef _WIN32
+    file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data_) {
+        Close();
+        return false;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+#else
+    file_ = open(path, O_RDONLY);
+    struct stat info;
+    if (file_ < 0 || fstat(file_, &info) != 0 || info.st_size == 0) {
+        Close();
+        return false;
+    }
+    void * data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file_, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    data_ = data;
+    size_ = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_) munmap(const_cast<void *>(data_), size_);
+    if (file_ >= 0) close(file_);
+    file_ = -1;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+//====================================================================================================
+// class StarCatalog:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constants:
+//----------------------------------------------------------------------------------------------------
+
+const int StarCatalog::TILE_SIDE;
+const int StarCatalog::TILE_COUNT;
+const int StarCatalog::BANDS;
+const GLuint StarCatalog::VERSION;
+const GLfloat StarCatalog::BAND_LIMITS[StarCatalog::BANDS - 1] = { 1.5f, 3.5f };
+
+static const char STAR_CATALOG_MAGIC[4] = { 'G', 'S', 'T', 'R' };
+
+static_assert(sizeof(StarRecord) == 16 && sizeof(StarCatalog::Header) == 16 && sizeof(StarCatalog::Tile) == 16,
+    "The records of the star catalog must be packed in 16 bytes");
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+StarCatalog::StarCatalog() : header_(nullptr), tiles_(nullptr), stars_(nullptr) {}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+bool StarCatalog::bind(const char * data, size_t size) {
+    // Check the header and the ranges of the tiles before any use of the data:
+    const size_t TABLE = sizeof(Header) + TILE_COUNT * sizeof(Tile);
+    if (size < TABLE) return false;
+    const Header * header = reinterpret_cast<const Header *>(data);
+    if (memcmp(header->magic, STAR_CATALOG_MAGIC, sizeof(STAR_CATALOG_MAGIC)) != 0 ||
+        header->version != VERSION || header->tiles != static_cast<GLuint>(TILE_COUNT) ||
+        (size - TABLE) / sizeof(StarRecord) < header->count) {
+        return false;
+    }
+    const Tile * tiles = reinterpret_cast<const Tile *>(data + sizeof(Header));
+    for (int i = 0; i < TILE_COUNT; ++i) {
+        size_t end = tiles[i].first;
+        for (int j = 0; j < BANDS; ++j) {
+            end += tiles[i].counts[j];
+        }
+        if (end > header->count) return false;
+    }
+    header_ = header;
+    tiles_ = tiles;
+    stars_ = reinterpret_cast<const StarRecord *>(data + TABLE);
+    return true;
+}
+
+bool StarCatalog::Load(const char * path) {
+    Clear();
+    if (!file_.Open(path)) return false;
+    if (!bind(static_cast<const char *>(file_.Data()), file_.Size())) {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+void StarCatalog::Build(const std::vector<StarRecord> & stars) {
+    // Sort the stars by tile and magnitude, and count the bands of every tile:
+    Clear();
+    std::vector<GLuint> order(stars.size());
+    std::vector<int> tiles(stars.size());
+    for (size_t i = 0; i < stars.size(); ++i) {
+        order[i] = static_cast<GLuint>(i);
+        tiles[i] = TileOf(stars[i].direction);
+    }
+    std::sort(order.begin(), order.end(), [&] (GLuint a, GLuint b) {
+        return tiles[a] != tiles[b] ? tiles[a] < tiles[b] : stars[a].magnitude < stars[b].magnitude;
+    });
+
+    const size_t TABLE = sizeof(Header) + TILE_COUNT * sizeof(Tile);
+    buffer_.assign(TABLE + stars.size() * sizeof(StarRecord), 0);
+    Header * header = reinterpret_cast<Header *>(buffer_.data());
+    Tile * table = reinterpret_cast<Tile *>(buffer_.data() + sizeof(Header));
+    StarRecord * records = reinterpret_cast<StarRecord *>(buffer_.data() + TABLE);
+    memcpy(header->magic, STAR_CATALOG_MAGIC, sizeof(STAR_CATALOG_MAGIC));
+    header->version = VERSION;
+    header->count = static_cast<GLuint>(stars.size());
+    header->tiles = TILE_COUNT;
+    for (int i = 0; i < TILE_COUNT; ++i) {
+        table[i].first = header->count;
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        const StarRecord & star = stars[order[i]];
+        Tile & tile = table[tiles[order[i]]];
+        if (tile.first == header->count) {
+            tile.first = static_cast<GLuint>(i);
+        }
+        ++tile.counts[BandOf(star.magnitude / 10.0f)];
+        records[i] = star;
+    }
+    for (int i = 0; i < TILE_COUNT; ++i) {
+        if (table[i].first == header->count) {
+            table[i].first = 0;
+        }
+    }
+    bind(buffer_.data(), buffer_.size());
+}
+
+void StarCatalog::Generate(size_t count, GLfloat maxMagnitude, unsigned int seed) {
+    // Uniform directions, with many more faint stars than bright ones (the count grows ~10^(m/2)):
+    const GLfloat MIN_MAGNITUDE = -1.5f;
+    const GLfloat TINTS[][3] = {
+        { 0.7f, 0.8f, 1.0f }, { 1.0f, 1.0f, 1.0f }, { 1.0f, 0.95f, 0.8f }, { 1.0f, 0.8f, 0.6f }, { 1.0f, 0.7f, 0.6f }
+    };
+    const int TINT_COUNT = sizeof(TINTS) / sizeof(TINTS[0]);
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<GLfloat> unit(0.0f, 1.0f);
+    std::vector<StarRecord> stars(count);
+    for (auto & star : stars) {
+        GLfloat z = 2.0f * unit(random) - 1.0f, angle = 2.0f * PI * unit(random), sine, cosine;
+        GLfloat r = std::sqrt(1.0f - z * z);
+        SinCos(angle, sine, cosine);
+        star.direction[0] = r * cosine, star.direction[1] = r * sine, star.direction[2] = z;
+        GLfloat magnitude = maxMagnitude + 2.0f * std::log10(1.0f - unit(random));
+        magnitude = magnitude > MIN_MAGNITUDE ? magnitude : MIN_MAGNITUDE;
+        GLfloat brightness = 1.0f - 0.75f * (magnitude - MIN_MAGNITUDE) / (maxMagnitude - MIN_MAGNITUDE);
+        const GLfloat * tint = TINTS[random() % TINT_COUNT];
+        for (int j = 0; j < 3; ++j) {
+            star.color[j] = static_cast<GLubyte>(tint[j] * brightness * 255.0f);
+        }
+        GLfloat tenths = std::floor(magnitude * 10.0f + 0.5f);
+        star.magnitude = static_cast<GLbyte>(tenths < 127.0f ? tenths : 127.0f);
+    }
+    Build(stars);
+}
+
+bool StarCatalog::Save(const char * path) const {
+    if (!header_) return false;
+    FILE * file = fopen(path, "wb");
+    if (!file) return false;
+    size_t size = sizeof(Header) + TILE_COUNT * sizeof(Tile) + header_->count * sizeof(StarRecord);
+    bool result = fwrite(header_, 1, size, file) == size;
+    fclose(file);
+    return result;
+}
+
+void StarCatalog::Clear() {
+    file_.Close();
+    std::vector<char>().swap(buffer_);
+    header_ = nullptr;
+    tiles_ = nullptr;
+    stars_ = nullptr;
+}
+
+//----------------------------------------------------------------------------------------------------
+// Static methods:
+//----------------------------------------------------------------------------------------------------
+
+int StarCatalog::TileOf(const GLfloat * direction) {
+    // The face is the axis with the largest component, and the grid uses the other two ones:
+    GLfloat ax = std::fabs(direction[0]), ay = std::fabs(direction[1]), az = std::fabs(direction[2]);
+    int face;
+    GLfloat u, v;
+    if (ax >= ay && ax >= az) {
+        face = direction[0] > 0.0f ? 0 : 1, u = direction[1] / ax, v = direction[2] / ax;
+    } else if (ay >= az) {
+        face = direction[1] > 0.0f ? 2 : 3, u = direction[0] / ay, v = direction[2] / ay;
+    } else {
+        face = direction[2] > 0.0f ? 4 : 5, u = direction[0] / az, v = direction[1] / az;
+    }
+    int i = static_cast<int>((u + 1.0f) * 0.5f * TILE_SIDE), j = static_cast<int>((v + 1.0f) * 0.5f * TILE_SIDE);
+    i = i < 0 ? 0 : (i < TILE_SIDE ? i : TILE_SIDE - 1);
+    j = j < 0 ? 0 : (j < TILE_SIDE ? j : TILE_SIDE - 1);
+    return (face * TILE_SIDE + j) * TILE_SIDE + i;
+}
+
+int StarCatalog::BandOf(GLfloat magnitude) {
+    for (int i = 0; i < BANDS - 1; ++i) {
+        if (magnitude < BAND_LIMITS[i]) return i;
+    }
+    return BANDS - 1;
+}
+
+void StarCatalog::TileCorner(int tile, GLfloat u, GLfloat v, GLfloat * direction) {
+    // The (u, v) coordinates go from 0 to 1 inside the tile:
+    int face = tile / (TILE_SIDE * TILE_SIDE), j = (tile / TILE_SIDE) % TILE_SIDE, i = tile % TILE_SIDE;
+    GLfloat a = -1.0f + 2.0f * (i + u) / TILE_SIDE, b = -1.0f + 2.0f * (j + v) / TILE_SIDE;
+    GLfloat sign = face % 2 ? -1.0f : 1.0f;
+    switch (face / 2) {
+    case 0: direction[0] = sign, direction[1] = a, direction[2] = b; break;
+    case 1: direction[0] = a, direction[1] = sign, direction[2] = b; break;
+    default: direction[0] = a, direction[1] = b, direction[2] = sign; break;
+    }
+    GLfloat length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    for (int k = 0; k < 3; ++k) {
+        direction[k] /= length;
+    }
+}
+
+//====================================================================================================
+// class StarField:
+//====================================================================================================
+
+//----------------------------------------------------------------------------------------------------
+// Constants:
+//----------------------------------------------------------------------------------------------------
+
+const GLfloat StarField::DISTANCE = 900.0f;
+const GLfloat StarField::POINT_SIZES[StarCatalog::BANDS] = { 3.0f, 2.0f, 1.0f };
+
+//----------------------------------------------------------------------------------------------------
+// Constructors:
+//----------------------------------------------------------------------------------------------------
+
+StarField::StarField() : ready_(false), drawnTiles_(0), drawnStars_(0) {
+    // The bounding sphere of a tile goes from its center to its farthest corner:
+    for (int i = 0; i < StarCatalog::TILE_COUNT; ++i) {
+        GLfloat center[3], corner[3], radius = 0.0f;
+        StarCatalog::TileCorner(i, 0.5f, 0.5f, center);
+        for (int k = 0; k < 4; ++k) {
+            StarCatalog::TileCorner(i, static_cast<GLfloat>(k % 2), static_cast<GLfloat>(k / 2), corner);
+            GLfloat dx = corner[0] - center[0], dy = corner[1] - center[1], dz = corner[2] - center[2];
+            GLfloat distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            radius = distance > radius ? distance : radius;
+        }
+        centers_[i] = Point3(center[0] * DISTANCE, center[1] * DISTANCE, center[2] * DISTANCE);
+        radii_[i] = radius * DISTANCE;
+    }
+}
+
+StarField::~StarField() {
+    if (loader_.joinable()) {
+        loader_.join();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+// Methods:
+//----------------------------------------------------------------------------------------------------
+
+void StarField::load(std::string path, size_t count, GLfloat maxMagnitude, unsigned int seed) {
+    // Without a catalog file a random sky is generated:
+    if (!catalog_.Load(path.c_str())) {
+        catalog_.Generate(count, maxMagnitude, seed);
+    }
+    const size_t PAGE = 4096;
+    const volatile char * data = static_cast<const char *>(catalog_.GetData());
+    size_t size = sizeof(StarCatalog::Header) + StarCatalog::TILE_COUNT * sizeof(StarCatalog::Tile) +
+        catalog_.Size() * sizeof(StarRecord);
+    char touched = 0;
+    for (size_t i = 0; i < size; i += PAGE) {
+        touched ^= data[i];
+    }
+    (void)touched;
+    ready_.store(true, std::memory_order_release);
+}
+
+void StarField::LoadAsync(const char * path, size_t count, GLfloat maxMagnitude, unsigned int seed) {
+    if (loader_.joinable() || IsReady()) return;
+    loader_ = std::thread(&StarField::load, this, std::string(path), count, maxMagnitude, seed);
+}
+
+void StarField::Draw(const Matrix & projection, const Matrix & rotation) {
+    drawnTiles_ = 0;
+    drawnStars_ = 0;
+    if (!IsReady() || !catalog_.Size()) return;
+
+    // Select the tiles inside the view:
+    Frustum frustum(projection * rotation);
+    int visible[StarCatalog::TILE_COUNT], count = 0;
+    for (int i = 0; i < StarCatalog::TILE_COUNT; ++i) {
+        if (frustum.Test(centers_[i], radii_[i]) != Frustum::OUTSIDE) {
+            visible[count++] = i;
+        }
+    }
+
+    // The stars are drawn behind everything, with their own projection and without the depth test:
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    projection.LoadInOpenGL();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    rotation.LoadInOpenGL();
+    glScalef(DISTANCE, DISTANCE, DISTANCE);
+    GLState::Disable(GL_LIGHTING);
+    GLState::Disable(GL_DEPTH_TEST);
+    GLState::BindTexture(0);
+    GLState::DisableClientState(GL_NORMAL_ARRAY);
+    GLState::DisableClientState(GL_TEXTURE_COORD_ARRAY);
+    GLState::EnableClientState(GL_COLOR_ARRAY);
+    const StarRecord * stars = catalog_.GetStars();
+    glVertexPointer(3, GL_FLOAT, sizeof(StarRecord), stars->direction);
+    glColorPointer(3, GL_UNSIGNED_BYTE, sizeof(StarRecord), stars->color);
+    for (int band = 0; band < StarCatalog::BANDS; ++band) {
+        GLState::PointSize(POINT_SIZES[band]);
+        for (int k = 0; k < count; ++k) {
+            const StarCatalog::Tile & tile = catalog_.GetTile(visible[k]);
+            GLuint first = tile.first;
+            for (int j = 0; j < band; ++j) {
+                first += tile.counts[j];
+            }
+            if (tile.counts[band]) {
+                glDrawArrays(GL_POINTS, first, tile.counts[band]);
+                drawnStars_ += tile.counts[band];
+            }
+        }
+    }
+    drawnTiles_ = count;
+    GLState::Enable(GL_DEPTH_TEST);
+    GLState::InvalidateColor();
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
 }
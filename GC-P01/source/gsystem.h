@@ -26,8 +26,25 @@
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <gl/GL.h>
+#include <cstring>
+#include <cstdint>
 #include <vector>
 #include <memory>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include "../../GC-Common/source/gtrig.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define GSYSTEM_SSE
+#include <xmmintrin.h>
+#endif
 
 //****************************************************************************************************
 //*************************************** General structures *****************************************
@@ -51,67 +68,136 @@ inline GLfloat DegToRad(GLfloat value) { return (value * PI) / 180.0f; }
 class Point3;
 class Vector3;
 class Quaternion;
+class Matrix;
 
 //----------------------------------------------------------------------------------------------------
 // Coordinates
 //----------------------------------------------------------------------------------------------------
 
+// The meaning of the W component is given by a tag at compile time instead of a virtual method,
+// so the coordinates have no vtable: 16 bytes, trivially copyable and with the layout of a __m128.
+
 class Coordinates {
 public:
-    static const int X_IDX, Y_IDX, Z_IDX, W_IDX;
-    static const GLfloat W_AS_VECTOR, W_AS_POINT;
+    static const int X_IDX = 0, Y_IDX = 1, Z_IDX = 2, W_IDX = 3;
+    static constexpr GLfloat W_AS_VECTOR = 0.0f;
+    static constexpr GLfloat W_AS_POINT = 1.0f;
 
 protected:
-    GLfloat4 data_;
+    alignas(16) GLfloat4 data_;
 
-    virtual void validateChanges() {}
+    Coordinates() {}
 
-public:
-    Coordinates(GLfloat x, GLfloat y, GLfloat z, GLfloat w);
-    Coordinates(const GLfloat * data);
-    Coordinates(const Coordinates & victim);
+    Coordinates(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+        data_[X_IDX] = x, data_[Y_IDX] = y, data_[Z_IDX] = z, data_[W_IDX] = w;
+    }
+
+    Coordinates(const GLfloat * data) {
+        memcpy(data_, data, ARRAY4_LENGTH * sizeof(GLfloat));
+    }
 
+public:
     inline GLfloat X() const { return data_[X_IDX]; }
     inline GLfloat Y() const { return data_[Y_IDX]; }
     inline GLfloat Z() const { return data_[Z_IDX]; }
     inline GLfloat W() const { return data_[W_IDX]; }
 
-    inline void X(GLfloat value) { data_[X_IDX] = value; validateChanges(); }
-    inline void Y(GLfloat value) { data_[Y_IDX] = value; validateChanges(); }
-    inline void Z(GLfloat value) { data_[Z_IDX] = value; validateChanges(); }
-    inline void W(GLfloat value) { data_[W_IDX] = value; validateChanges(); }
+    inline const GLfloat * Get() const { return data_; }
 
-    const GLfloat * Get() const;
-    void Set(const Coordinates & value);
-    void Set(const GLfloat * data);
-    void Set(GLfloat x, GLfloat y, GLfloat z);
-    void Set(GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+#ifdef GSYSTEM_SSE
+    inline __m128 Simd() const { return _mm_loadu_ps(data_); }
+#endif
 
-    Coordinates & operator =(const Coordinates & rhs);
     bool operator ==(const Coordinates & rhs) const;
     bool operator !=(const Coordinates & rhs) const;
 };
 
 //----------------------------------------------------------------------------------------------------
-// Point3
-//----------------------------------------------------------------------------------------------------
 
-class Point3 : public Coordinates {
+struct WFree {
+    static inline void Validate(GLfloat4 &) {}
+};
+
+struct WVector {
+    static inline void Validate(GLfloat4 & data) { data[Coordinates::W_IDX] = Coordinates::W_AS_VECTOR; }
+};
+
+struct WPoint {
+    static inline void Validate(GLfloat4 & data) { data[Coordinates::W_IDX] = Coordinates::W_AS_POINT; }
+};
+
+template <typename TW>
+class TypedCoordinates : public Coordinates {
 protected:
-    virtual void validateChanges();
+    inline void validateChanges() { TW::Validate(data_); }
+
+    TypedCoordinates() {}
+
+    TypedCoordinates(GLfloat x, GLfloat y, GLfloat z, GLfloat w) : Coordinates(x, y, z, w) {
+        validateChanges();
+    }
+
+    TypedCoordinates(const GLfloat * data) : Coordinates(data) {
+        validateChanges();
+    }
 
+public:
+    using Coordinates::X;
+    using Coordinates::Y;
+    using Coordinates::Z;
+    using Coordinates::W;
+
+    inline void X(GLfloat value) { data_[X_IDX] = value; }
+    inline void Y(GLfloat value) { data_[Y_IDX] = value; }
+    inline void Z(GLfloat value) { data_[Z_IDX] = value; }
+    inline void W(GLfloat value) { data_[W_IDX] = value; validateChanges(); }
+
+#ifdef GSYSTEM_SSE
+    using Coordinates::Simd;
+    inline void Simd(__m128 value) { _mm_storeu_ps(data_, value); validateChanges(); }
+#endif
+
+    inline void Set(const Coordinates & value) {
+        memcpy(data_, value.Get(), ARRAY4_LENGTH * sizeof(GLfloat));
+        validateChanges();
+    }
+
+    inline void Set(const GLfloat * data) {
+        memcpy(data_, data, ARRAY4_LENGTH * sizeof(GLfloat));
+        validateChanges();
+    }
+
+    inline void Set(GLfloat x, GLfloat y, GLfloat z) {
+        data_[X_IDX] = x, data_[Y_IDX] = y, data_[Z_IDX] = z;
+    }
+
+    inline void Set(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+        data_[X_IDX] = x, data_[Y_IDX] = y, data_[Z_IDX] = z, data_[W_IDX] = w;
+        validateChanges();
+    }
+};
+
+//----------------------------------------------------------------------------------------------------
+// Point3
+//----------------------------------------------------------------------------------------------------
+
+class Point3 : public TypedCoordinates<WPoint> {
 public:
     static const Point3 ZERO;
 
     Point3(GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat z = 0.0f);
     Point3(const GLfloat * data);
-    Point3(const Point3 & victim);
     Point3(const Vector3 & victim);
 
-    Point3 operator +(const Vector3 & rhs);
-    Point3 operator -(const Vector3 & rhs);
-    Point3 operator *(const Vector3 & rhs);
-    Point3 operator /(const Vector3 & rhs);
+    Point3 operator +(const Vector3 & rhs) const;
+    Point3 operator -(const Vector3 & rhs) const;
+    Point3 operator *(const Vector3 & rhs) const;
+    Point3 operator /(const Vector3 & rhs) const;
+
+    Point3 & operator +=(const Vector3 & rhs);
+    Point3 & operator -=(const Vector3 & rhs);
+
+    Point3 & AddScaled(const Vector3 & direction, GLfloat amount);
 
     friend class Vector3;
 };
@@ -120,10 +206,7 @@ public:
 // Vector3
 //----------------------------------------------------------------------------------------------------
 
-class Vector3 : public Coordinates {
-protected:
-    virtual void validateChanges();
-
+class Vector3 : public TypedCoordinates<WVector> {
 public:
     static const Vector3 ZERO;
     static const Vector3 IDENTITY;
@@ -139,7 +222,6 @@ public:
 
     Vector3(GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat z = 0.0f);
     Vector3(const GLfloat * data);
-    Vector3(const Vector3 & victim);
     Vector3(const Point3 & victim);
 
     GLfloat Length() const;
@@ -159,6 +241,13 @@ public:
     Vector3 operator *(const Vector3 & rhs) const;
     Vector3 operator /(const Vector3 & rhs) const;
 
+    Vector3 & operator +=(const Vector3 & rhs);
+    Vector3 & operator -=(const Vector3 & rhs);
+    Vector3 & operator *=(GLfloat rhs);
+    Vector3 & operator /=(GLfloat rhs);
+
+    Vector3 & AddScaled(const Vector3 & direction, GLfloat amount);
+
     friend Vector3 operator *(const Vector3 & lhs, GLfloat rhs);
     friend Vector3 operator *(GLfloat lhs, const Vector3 & rhs);
     friend Vector3 operator /(const Vector3 & lhs, GLfloat rhs);
@@ -167,35 +256,400 @@ public:
     friend class Point3;
 };
 
-Vector3 operator *(const Vector3 & lhs, GLfloat rhs);
-Vector3 operator *(GLfloat lhs, const Vector3 & rhs);
-Vector3 operator /(const Vector3 & lhs, GLfloat rhs);
-Vector3 operator /(GLfloat lhs, const Vector3 & rhs);
+//----------------------------------------------------------------------------------------------------
+
+// The constructors and the arithmetic of Point3 and Vector3 are inline, so an expression like
+// "eye + direction * amount" is reduced by the compiler to a few multiply-adds in registers. The
+// compound operators and AddScaled work in place, without any temporary object.
+
+inline Point3::Point3 (GLfloat x, GLfloat y, GLfloat z) : TypedCoordinates(x, y, z, W_AS_POINT) {}
+
+inline Point3::Point3 (const GLfloat * data) : TypedCoordinates(data) {}
+
+inline Point3::Point3 (const Vector3 & victim) : TypedCoordinates(victim.data_[X_IDX], victim.data_[Y_IDX],
+    victim.data_[Z_IDX], W_AS_POINT) {}
+
+inline Vector3::Vector3 (GLfloat x, GLfloat y, GLfloat z) : TypedCoordinates(x, y, z, W_AS_VECTOR) {}
+
+inline Vector3::Vector3 (const GLfloat * data) : TypedCoordinates(data) {}
+
+inline Vector3::Vector3 (const Point3 & victim) : TypedCoordinates(victim.data_[X_IDX], victim.data_[Y_IDX],
+    victim.data_[Z_IDX], W_AS_VECTOR) {}
+
+inline Point3 Point3::operator +(const Vector3 & rhs) const {
+    return Point3(
+        data_[X_IDX] + rhs.data_[X_IDX],
+        data_[Y_IDX] + rhs.data_[Y_IDX],
+        data_[Z_IDX] + rhs.data_[Z_IDX]
+    );
+}
+
+inline Point3 Point3::operator -(const Vector3 & rhs) const {
+    return Point3(
+        data_[X_IDX] - rhs.data_[X_IDX],
+        data_[Y_IDX] - rhs.data_[Y_IDX],
+        data_[Z_IDX] - rhs.data_[Z_IDX]
+    );
+}
+
+inline Point3 Point3::operator *(const Vector3 & rhs) const {
+    return Point3(
+        data_[X_IDX] * rhs.data_[X_IDX],
+        data_[Y_IDX] * rhs.data_[Y_IDX],
+        data_[Z_IDX] * rhs.data_[Z_IDX]
+    );
+}
+
+inline Point3 Point3::operator /(const Vector3 & rhs) const {
+    return Point3(
+        data_[X_IDX] / rhs.data_[X_IDX],
+        data_[Y_IDX] / rhs.data_[Y_IDX],
+        data_[Z_IDX] / rhs.data_[Z_IDX]
+    );
+}
+
+inline Point3 & Point3::operator +=(const Vector3 & rhs) {
+    data_[X_IDX] += rhs.data_[X_IDX];
+    data_[Y_IDX] += rhs.data_[Y_IDX];
+    data_[Z_IDX] += rhs.data_[Z_IDX];
+    return *this;
+}
+
+inline Point3 & Point3::operator -=(const Vector3 & rhs) {
+    data_[X_IDX] -= rhs.data_[X_IDX];
+    data_[Y_IDX] -= rhs.data_[Y_IDX];
+    data_[Z_IDX] -= rhs.data_[Z_IDX];
+    return *this;
+}
+
+inline Point3 & Point3::AddScaled(const Vector3 & direction, GLfloat amount) {
+    data_[X_IDX] += direction.data_[X_IDX] * amount;
+    data_[Y_IDX] += direction.data_[Y_IDX] * amount;
+    data_[Z_IDX] += direction.data_[Z_IDX] * amount;
+    return *this;
+}
+
+inline GLfloat Vector3::LengthSquared() const {
+    return data_[X_IDX] * data_[X_IDX] +
+           data_[Y_IDX] * data_[Y_IDX] +
+           data_[Z_IDX] * data_[Z_IDX];
+}
+
+inline GLfloat Vector3::Dot(const Vector3 & rhs) const {
+    return data_[X_IDX] * rhs.data_[X_IDX] +
+           data_[Y_IDX] * rhs.data_[Y_IDX] +
+           data_[Z_IDX] * rhs.data_[Z_IDX];
+}
+
+inline Vector3 Vector3::Cross(const Vector3 & rhs) const {
+    return Vector3(
+        data_[Y_IDX] * rhs.data_[Z_IDX] - data_[Z_IDX] * rhs.data_[Y_IDX],
+        data_[Z_IDX] * rhs.data_[X_IDX] - data_[X_IDX] * rhs.data_[Z_IDX],
+        data_[X_IDX] * rhs.data_[Y_IDX] - data_[Y_IDX] * rhs.data_[X_IDX]
+    );
+}
+
+inline Vector3 Vector3::operator -() const {
+    return Vector3(-data_[X_IDX], -data_[Y_IDX], -data_[Z_IDX]);
+}
+
+inline Vector3 Vector3::operator +(const Vector3 & rhs) const {
+    return Vector3(
+        data_[X_IDX] + rhs.data_[X_IDX],
+        data_[Y_IDX] + rhs.data_[Y_IDX],
+        data_[Z_IDX] + rhs.data_[Z_IDX]
+    );
+}
+
+inline Vector3 Vector3::operator -(const Vector3 & rhs) const {
+    return Vector3(
+        data_[X_IDX] - rhs.data_[X_IDX],
+        data_[Y_IDX] - rhs.data_[Y_IDX],
+        data_[Z_IDX] - rhs.data_[Z_IDX]
+    );
+}
+
+inline Vector3 Vector3::operator *(const Vector3 & rhs) const {
+    return Vector3(
+        data_[X_IDX] * rhs.data_[X_IDX],
+        data_[Y_IDX] * rhs.data_[Y_IDX],
+        data_[Z_IDX] * rhs.data_[Z_IDX]
+    );
+}
+
+inline Vector3 Vector3::operator /(const Vector3 & rhs) const {
+    return Vector3(
+        data_[X_IDX] / rhs.data_[X_IDX],
+        data_[Y_IDX] / rhs.data_[Y_IDX],
+        data_[Z_IDX] / rhs.data_[Z_IDX]
+    );
+}
+
+inline Vector3 & Vector3::operator +=(const Vector3 & rhs) {
+    data_[X_IDX] += rhs.data_[X_IDX];
+    data_[Y_IDX] += rhs.data_[Y_IDX];
+    data_[Z_IDX] += rhs.data_[Z_IDX];
+    return *this;
+}
+
+inline Vector3 & Vector3::operator -=(const Vector3 & rhs) {
+    data_[X_IDX] -= rhs.data_[X_IDX];
+    data_[Y_IDX] -= rhs.data_[Y_IDX];
+    data_[Z_IDX] -= rhs.data_[Z_IDX];
+    return *this;
+}
+
+inline Vector3 & Vector3::operator *=(GLfloat rhs) {
+    data_[X_IDX] *= rhs;
+    data_[Y_IDX] *= rhs;
+    data_[Z_IDX] *= rhs;
+    return *this;
+}
+
+inline Vector3 & Vector3::operator /=(GLfloat rhs) {
+    data_[X_IDX] /= rhs;
+    data_[Y_IDX] /= rhs;
+    data_[Z_IDX] /= rhs;
+    return *this;
+}
+
+inline Vector3 & Vector3::AddScaled(const Vector3 & direction, GLfloat amount) {
+    data_[X_IDX] += direction.data_[X_IDX] * amount;
+    data_[Y_IDX] += direction.data_[Y_IDX] * amount;
+    data_[Z_IDX] += direction.data_[Z_IDX] * amount;
+    return *this;
+}
+
+inline Vector3 operator *(const Vector3 & lhs, GLfloat rhs) {
+    return Vector3(
+        lhs.data_[Coordinates::X_IDX] * rhs,
+        lhs.data_[Coordinates::Y_IDX] * rhs,
+        lhs.data_[Coordinates::Z_IDX] * rhs
+    );
+}
+
+inline Vector3 operator *(GLfloat lhs, const Vector3 & rhs) {
+    return Vector3(
+        rhs.data_[Coordinates::X_IDX] * lhs,
+        rhs.data_[Coordinates::Y_IDX] * lhs,
+        rhs.data_[Coordinates::Z_IDX] * lhs
+    );
+}
+
+inline Vector3 operator /(const Vector3 & lhs, GLfloat rhs) {
+    return Vector3(
+        lhs.data_[Coordinates::X_IDX] / rhs,
+        lhs.data_[Coordinates::Y_IDX] / rhs,
+        lhs.data_[Coordinates::Z_IDX] / rhs
+    );
+}
+
+inline Vector3 operator /(GLfloat lhs, const Vector3 & rhs) {
+    return Vector3(
+        rhs.data_[Coordinates::X_IDX] / lhs,
+        rhs.data_[Coordinates::Y_IDX] / lhs,
+        rhs.data_[Coordinates::Z_IDX] / lhs
+    );
+}
 
 //----------------------------------------------------------------------------------------------------
 // Quaternion
 //----------------------------------------------------------------------------------------------------
 
-class Quaternion : public Coordinates {
+class Quaternion : public TypedCoordinates<WFree> {
 public:
+    static const Quaternion IDENTITY;
+
     Quaternion (GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat z = 0.0f, GLfloat w = 0.0f);
     Quaternion (const GLfloat * data);
-    Quaternion (const Quaternion & victim);
+
+    static Quaternion FromAxisAngle (const Vector3 & axis, GLfloat angle);
+    static Quaternion FromMatrix (const Matrix & victim);
 
     GLfloat Length() const;
     GLfloat LengthSquared() const;
     Quaternion Normalized() const;
     void Normalize();
 
+    GLfloat Dot (const Quaternion & rhs) const;
     Quaternion Conjugate () const;
+    Quaternion Inverse () const;
+    Matrix ToMatrix () const;
+
+    Vector3 Rotate (const Vector3 & victim) const;
+    Point3 Rotate (const Point3 & victim) const;
+
+    static Quaternion Nlerp (const Quaternion & from, const Quaternion & to, GLfloat amount);
+    static Quaternion Slerp (const Quaternion & from, const Quaternion & to, GLfloat amount);
+
+    static void Rotate (const Quaternion & rotation, const Vector3 * source, Vector3 * destination,
+        size_t count);
+    static void Slerp (const Quaternion * from, const Quaternion * to, GLfloat amount,
+        Quaternion * destination, size_t count);
 
     Quaternion operator * (Quaternion rhs) const;
 };
 
+//----------------------------------------------------------------------------------------------------
+// Matrix
+//----------------------------------------------------------------------------------------------------
+
+// Column-major 4x4 matrix, with the same layout and conventions used by OpenGL.
+
+class Matrix {
+public:
+    static const int SIDE = 4, LENGTH = 16;
+    static const Matrix IDENTITY;
+
+private:
+    alignas(16) GLfloat data_[LENGTH];
+
+public:
+    Matrix ();
+    Matrix (const GLfloat * data);
+
+    inline GLfloat Get (int row, int col) const { return data_[col * SIDE + row]; }
+    inline void Set (int row, int col, GLfloat value) { data_[col * SIDE + row] = value; }
+
+    inline const GLfloat * Get () const { return data_; }
+    void Set (const GLfloat * data);
+
+    void SetAsIdentity ();
+    void SetAsTranslate (GLfloat x, GLfloat y, GLfloat z);
+    void SetAsScale (GLfloat x, GLfloat y, GLfloat z);
+    void SetAsRotate (GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+    void SetAsOrtho (GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar);
+    void SetAsPerspective (GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar);
+    void SetAsLookAt (const Point3 & eye, const Point3 & look, const Vector3 & up);
+
+    void AddTranslate (GLfloat x, GLfloat y, GLfloat z);
+    void AddScale (GLfloat x, GLfloat y, GLfloat z);
+    void AddRotate (GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+    void AddMultiply (const Matrix & rhs);
+
+    void LoadInOpenGL () const;
+    void MultiplyInOpenGL () const;
+
+    Matrix operator * (const Matrix & rhs) const;
+    Point3 operator * (const Point3 & rhs) const;
+    Vector3 operator * (const Vector3 & rhs) const;
+
+    static void Multiply (const GLfloat * lhs, const GLfloat * rhs, GLfloat * result);
+};
+
+static_assert(sizeof(Point3) == sizeof(GLfloat4) && std::is_trivially_copyable<Point3>::value,
+    "Point3 must be a plain 16 bytes value");
+static_assert(sizeof(Vector3) == sizeof(GLfloat4) && std::is_trivially_copyable<Vector3>::value,
+    "Vector3 must be a plain 16 bytes value");
+static_assert(sizeof(Quaternion) == sizeof(GLfloat4) && std::is_trivially_copyable<Quaternion>::value,
+    "Quaternion must be a plain 16 bytes value");
+
+//----------------------------------------------------------------------------------------------------
+// Frustum
+//----------------------------------------------------------------------------------------------------
+
+// The six planes of a view volume, extracted from a projection * view matrix. The planes point
+// inwards and they are normalized, so the test of a sphere is a dot product for each plane.
+
+class Frustum {
+public:
+    enum Result { OUTSIDE, INTERSECT, INSIDE };
+    static const int PLANES = 6;
+
+private:
+    GLfloat4 planes_[PLANES];
+
+public:
+    Frustum ();
+    Frustum (const Matrix & victim);
+
+    void Set (const Matrix & victim);
+    Result Test (const Point3 & center, GLfloat radius) const;
+};
+
+//----------------------------------------------------------------------------------------------------
+// SceneView
+//----------------------------------------------------------------------------------------------------
+
+// Camera, projection and viewport used to draw a scene: the frustum for the culling and the size in
+// pixels of a sphere for the level of detail, with an orthographic or a perspective projection.
+
+class SceneView {
+private:
+    Matrix viewProjection_;
+    Frustum frustum_;
+    GLfloat pixelScale_;
+
+public:
+    SceneView (const Matrix & projection, const Matrix & view, GLsizei viewportHeight);
+
+    inline const Matrix & GetViewProjection () const { return viewProjection_; }
+    inline const Frustum & GetFrustum () const { return frustum_; }
+
+    GLfloat ScreenRadius (const Point3 & center, GLfloat radius) const;
+};
+
 //****************************************************************************************************
 //******************************************** Materials *********************************************
 //****************************************************************************************************
 
+//----------------------------------------------------------------------------------------------------
+// GLState
+//----------------------------------------------------------------------------------------------------
+
+// Shadow copy of the OpenGL state changed while drawing: capabilities, client arrays, line width,
+// point size, texture binding, current color and front material. A call that wouldn't change the
+// state is skipped and counted. Any code that changes this state directly must call the matching
+// Invalidate method. GL_COLOR_MATERIAL tracks the ambient and diffuse colors, so a change of them
+// forces the next color.
+
+class GLState {
+public:
+    static const int MAX_ENTRIES = 16;
+
+private:
+    struct Entry {
+        GLenum name;
+        bool enabled;
+    };
+
+    enum MaterialIndex { AMBIENT_IDX, DIFFUSE_IDX, SPECULAR_IDX, EMISSION_IDX, MATERIAL_COUNT };
+
+    static Entry capabilities_[MAX_ENTRIES];
+    static Entry clientStates_[MAX_ENTRIES];
+    static int capabilityCount_, clientStateCount_;
+    static GLfloat lineWidth_, pointSize_, shininess_;
+    static GLuint texture_;
+    static GLfloat4 color_;
+    static GLfloat4 material_[MATERIAL_COUNT];
+    static bool validLineWidth_, validPointSize_, validShininess_, validTexture_, validColor_;
+    static bool validMaterial_[MATERIAL_COUNT];
+    static size_t issued_, skipped_;
+
+    static bool change(Entry * entries, int & count, GLenum name, bool enabled);
+    static bool changeVector(GLfloat4 & shadow, bool & valid, const GLfloat * value);
+
+public:
+    static void Invalidate();
+    static void InvalidateTexture();
+    static void InvalidateColor();
+
+    static void Enable(GLenum capability);
+    static void Disable(GLenum capability);
+    static void EnableClientState(GLenum array);
+    static void DisableClientState(GLenum array);
+    static void LineWidth(GLfloat value);
+    static void PointSize(GLfloat value);
+    static void BindTexture(GLuint value);
+    static void Color(const GLfloat * value);
+    static void Material(GLenum name, const GLfloat * value);
+    static void Material(GLenum name, GLfloat value);
+
+    static inline size_t Issued() { return issued_; }
+    static inline size_t Skipped() { return skipped_; }
+    static void ResetCounters();
+};
+
 //----------------------------------------------------------------------------------------------------
 // Texture
 //----------------------------------------------------------------------------------------------------
@@ -253,9 +707,80 @@ public:
     void SetShininess(GLfloat value);
     void SetTexture(GLuint value);
 
+    inline GLuint GetTexture() const { return texture_; }
+    GLuint GetKey() const;
+
     void Apply();
 };
 
+//****************************************************************************************************
+//********************************************* Geometry *********************************************
+//****************************************************************************************************
+
+//----------------------------------------------------------------------------------------------------
+// GeometryBuffer
+//----------------------------------------------------------------------------------------------------
+
+// Tessellation of a figure stored in vertex arrays, drawn with a single glDrawElements. The buffers
+// are built once by the cache and shared by every object with the same parameters.
+
+class GeometryBuffer {
+private:
+    GLenum mode_;
+    std::vector<GLfloat> vertices_;
+    std::vector<GLfloat> normals_;
+    std::vector<GLfloat> texcoords_;
+    std::vector<GLuint> indices_;
+
+    typedef std::tuple<int, GLdouble, GLint, GLint> Key;
+    static std::map<Key, std::shared_ptr<const GeometryBuffer>> & cache();
+
+public:
+    GeometryBuffer(GLenum mode);
+
+    inline size_t VertexCount() const { return vertices_.size() / 3; }
+    inline size_t IndexCount() const { return indices_.size(); }
+
+    void BuildSphere(GLdouble radius, GLint slices, GLint stacks);
+    void BuildCircle(GLdouble radius, GLint slices);
+    void Draw() const;
+
+    static std::shared_ptr<const GeometryBuffer> Sphere(GLdouble radius, GLint slices, GLint stacks);
+    static std::shared_ptr<const GeometryBuffer> Disk(GLdouble radius, GLint slices, GLint loops);
+    static void ClearCache();
+};
+
+//----------------------------------------------------------------------------------------------------
+// LevelOfDetail
+//----------------------------------------------------------------------------------------------------
+
+// Chain of tessellation levels, from the finest one to the coarsest one, halving the slices each time.
+// A level is chosen to keep the edges of the silhouette about PIXELS_PER_EDGE pixels long, and a coarser
+// level is only taken when the size is a HYSTERESIS fraction below its limit, so the level doesn't pop
+// back and forth when the size is near a limit.
+
+class LevelOfDetail {
+public:
+    static const int MAX_LEVELS = 4;
+    static const GLfloat PIXELS_PER_EDGE;
+    static const GLfloat HYSTERESIS;
+
+private:
+    GLint slices_[MAX_LEVELS];
+    int count_;
+    int current_;
+
+public:
+    LevelOfDetail();
+
+    inline int Count() const { return count_; }
+    inline int Current() const { return current_; }
+    inline GLint Slices(int level) const { return slices_[level]; }
+
+    void SetChain(GLint slices, GLint minimum);
+    int Select(GLfloat pixels);
+};
+
 //****************************************************************************************************
 //******************************************* Scene graph ********************************************
 //****************************************************************************************************
@@ -264,19 +789,563 @@ public:
 // NodeObject
 //----------------------------------------------------------------------------------------------------
 
+// A node is drawn in two parts: the local transform, that is shared with the childrens, and the
+// geometry, that is drawn after it and can change the modelview matrix (it's always drawn between a
+// glPushMatrix and a glPopMatrix). Draw does it recursively with the OpenGL matrix stack, and
+// FlatScene keeps the same nodes in an array to compute the transforms without OpenGL.
+// The nodes must call SetDirty when their local transform or their radius changes, so FlatScene
+// only has to recompute the world matrices and the bounding spheres of the changed subtrees.
+// The radius is the bounding sphere of the geometry around the origin of the node, and its size
+// on the screen is given to SelectDetail before each draw with a SceneView. The pass groups the
+// nodes that need the same capabilities in the render queue. SetTime moves the animated nodes to
+// their state at a time of the simulation, without depending on their previous state. PrepareView
+// is called after SelectDetail, with the world matrix of the node, so a node with many parts can cull
+// them and choose their detail before its draw.
+
 class NodeObject {
+public:
+    enum Pass { LIT_PASS = 0, UNLIT_PASS = 1 };
+
 protected:
     Material material_;
     std::vector<NodeObject *> childrens_;
+    bool dirty_;
     void drawChildrens();
 public:
     NodeObject();
     virtual ~NodeObject();
     Material & GetMaterial();
+    inline const std::vector<NodeObject *> & GetChildrens() const { return childrens_; }
     void AddChildren(NodeObject * victim);
     void ClearChildrens();
+    inline bool IsDirty() const { return dirty_; }
+    inline void SetDirty() { dirty_ = true; }
+    inline void ClearDirty() { dirty_ = false; }
     virtual void Initialize();
-    virtual void Draw();
+    virtual void GetLocalMatrix(Matrix & victim) const;
+    virtual GLfloat GetRadius() const;
+    virtual Pass GetPass() const;
+    virtual void SelectDetail(GLfloat pixels);
+    virtual void PrepareView(const SceneView & view, const Matrix & world);
+    virtual void SetTime(GLdouble seconds);
+    virtual void DrawGeometry();
+    void Draw();
+};
+
+//----------------------------------------------------------------------------------------------------
+// RenderQueue
+//----------------------------------------------------------------------------------------------------
+
+// List of draw packets emitted by the traversal of a scene and submitted later in a single loop.
+// The packets are sorted by a 64-bit key with the pass in the highest bits, then the material, then
+// the texture, and the transform index in the lowest bits to keep the order of equal states stable.
+// So the nodes with the same state are drawn together and GLState skips most of the changes.
+
+class FlatScene;
+
+class RenderQueue {
+public:
+    static const int PASS_BITS = 4, MATERIAL_BITS = 24, TEXTURE_BITS = 16, INDEX_BITS = 20;
+
+    struct Packet {
+        uint64_t key;
+        GLuint transform;
+        NodeObject * geometry;
+    };
+
+private:
+    std::vector<Packet> packets_;
+
+public:
+    RenderQueue();
+
+    inline size_t Size() const { return packets_.size(); }
+    inline const Packet & GetPacket(size_t index) const { return packets_[index]; }
+
+    void Clear();
+    void Push(NodeObject * geometry, GLuint transform);
+    void Sort();
+    void Submit(const FlatScene & scene) const;
+
+    static uint64_t MakeKey(GLuint pass, GLuint material, GLuint texture, GLuint index);
+};
+
+//----------------------------------------------------------------------------------------------------
+// CommandList
+//----------------------------------------------------------------------------------------------------
+
+// Display list recorded once and replayed many times, meant for static geometry, because the client
+// arrays are copied into the list. GLState is invalidated before the recording, so the list sets every
+// state it uses and doesn't depend on the state of the replay, after it, because the recorded calls
+// weren't executed, and after every replay, because the state changed behind it.
+
+class CommandList {
+private:
+    GLuint name_;
+
+public:
+    CommandList();
+    ~CommandList();
+
+    inline GLuint Name() const { return name_; }
+
+    void Begin();
+    void End();
+    void Call() const;
+    void Release();
+};
+
+//----------------------------------------------------------------------------------------------------
+// FlatScene
+//----------------------------------------------------------------------------------------------------
+
+// Compiled version of a hierarchy of nodes, stored in depth-first order, so the parent of a node
+// is always before it and the world matrices are computed with a single linear pass. Only the dirty
+// nodes and their descendants are recomputed, the rest of the matrices are kept from the last update.
+// Every node has a bounding sphere of its geometry and another one of its whole subtree, so a subtree
+// outside the frustum is rejected with a single test.
+
+class FlatScene {
+private:
+    std::vector<NodeObject *> objects_;
+    std::vector<int> parents_;
+    std::vector<size_t> ends_;
+    std::vector<Matrix> locals_;
+    std::vector<Matrix> worlds_;
+    std::vector<bool> changed_;
+    std::vector<Point3> centers_;
+    std::vector<GLfloat> radii_;
+    std::vector<Point3> boundCenters_;
+    std::vector<GLfloat> boundRadii_;
+    std::vector<bool> boundChanged_;
+    size_t recomputed_, reused_, drawn_, culled_;
+    void compile(NodeObject * victim, int parent);
+    void updateBounds();
+    RenderQueue queue_;
+    void drawNode(size_t index);
+    void collectNode(size_t index, const SceneView & view, RenderQueue & queue);
+public:
+    static const int NO_PARENT = -1;
+
+    FlatScene();
+    inline size_t Size() const { return objects_.size(); }
+    inline NodeObject * GetObject(size_t index) const { return objects_[index]; }
+    inline int GetParent(size_t index) const { return parents_[index]; }
+    inline const Matrix & GetLocal(size_t index) const { return locals_[index]; }
+    inline const Matrix & GetWorld(size_t index) const { return worlds_[index]; }
+    inline size_t GetSubtreeEnd(size_t index) const { return ends_[index]; }
+    inline const Point3 & GetCenter(size_t index) const { return centers_[index]; }
+    inline GLfloat GetRadius(size_t index) const { return radii_[index]; }
+    inline const Point3 & GetBoundCenter(size_t index) const { return boundCenters_[index]; }
+    inline GLfloat GetBoundRadius(size_t index) const { return boundRadii_[index]; }
+    inline bool HasChanged(size_t index) const { return changed_[index]; }
+    inline size_t GetRecomputed() const { return recomputed_; }
+    inline size_t GetReused() const { return reused_; }
+    inline size_t GetDrawn() const { return drawn_; }
+    inline size_t GetCulled() const { return culled_; }
+    void Compile(NodeObject * root);
+    void Clear();
+    void Update();
+    void SetTime(GLdouble seconds);
+    void Draw();
+    void Draw(const SceneView & view);
+    void Prepare(const SceneView & view);
+    void Submit() const;
+    void Collect(const SceneView & view, RenderQueue & queue);
+};
+
+//****************************************************************************************************
+//******************************************** Simulation ********************************************
+//****************************************************************************************************
+
+//----------------------------------------------------------------------------------------------------
+// AngularMotion
+//----------------------------------------------------------------------------------------------------
+
+// Angle that changes at a constant rate, given by its phase (the angle at time zero) and its rate in
+// degrees per second. It's evaluated directly at any time, so no error is accumulated between steps
+// and the time can jump, go backwards or change its speed.
+
+class AngularMotion {
+private:
+    GLdouble rate_;
+    GLdouble phase_;
+
+public:
+    AngularMotion();
+    AngularMotion(GLdouble rate, GLdouble phase = 0.0);
+
+    inline GLdouble GetRate() const { return rate_; }
+    inline GLdouble GetPhase() const { return phase_; }
+    GLdouble GetPeriod() const;
+
+    GLdouble At(GLdouble seconds) const;
+
+    static AngularMotion FromPeriod(GLdouble period, GLdouble phase = 0.0);
+};
+
+//----------------------------------------------------------------------------------------------------
+// SimulationClock
+//----------------------------------------------------------------------------------------------------
+
+// Fixed timestep clock: the elapsed real time is accumulated and consumed in ticks of the same length,
+// so the speed of the simulation doesn't depend on the frame rate. Advance returns the ticks to run
+// this frame, up to a maximum of catch-up steps (the rest of the time is dropped after a long stall),
+// and GetAlpha the fraction of a tick left, to interpolate between the previous and current states.
+
+class SimulationClock {
+private:
+    GLdouble tickSeconds_;
+    GLdouble accumulator_;
+    GLdouble lastTime_;
+    GLdouble windowStart_;
+    GLdouble measuredRate_;
+    int maxSteps_;
+    int steps_;
+    int windowTicks_;
+    size_t ticks_;
+
+public:
+    SimulationClock(GLdouble tickRate, int maxSteps);
+
+    inline GLdouble GetTickRate() const { return 1.0 / tickSeconds_; }
+    inline GLdouble GetTickSeconds() const { return tickSeconds_; }
+    inline GLdouble GetMeasuredRate() const { return measuredRate_; }
+    inline GLdouble GetAlpha() const { return accumulator_ / tickSeconds_; }
+    inline int GetMaxSteps() const { return maxSteps_; }
+    inline int GetSteps() const { return steps_; }
+    inline size_t GetTicks() const { return ticks_; }
+
+    void SetTickRate(GLdouble value);
+    void SetMaxSteps(int value);
+    void Reset(GLdouble seconds);
+    int Advance(GLdouble seconds);
+};
+
+//----------------------------------------------------------------------------------------------------
+// KeplerOrbit
+//----------------------------------------------------------------------------------------------------
+
+// Elliptical orbit in the XZ plane, turned by the argument of the periapsis around Y and then tilted
+// by the inclination around X. The angles are in degrees, the times in seconds and the phase is the
+// mean anomaly at time zero. Kepler's equation is solved with Newton's method.
+
+struct KeplerOrbit {
+    GLdouble semiMajor;
+    GLdouble eccentricity;
+    GLdouble inclination;
+    GLdouble periapsis;
+    GLdouble period;
+    GLdouble phase;
+
+    void Position(GLdouble seconds, GLfloat * position) const;
+};
+
+//----------------------------------------------------------------------------------------------------
+// Ephemeris
+//----------------------------------------------------------------------------------------------------
+
+// Positions of several bodies over time, stored as Chebyshev series in segments of the same length.
+// The table is fitted once from any model, and then every body is evaluated with a Clenshaw recurrence
+// (the three coordinates at the same time with SSE), so the cost doesn't depend on the model. The
+// table is packed by segment, body and coefficient, with 4 floats for each coefficient, and it repeats
+// after its duration, so the duration must be a common period of every body (see CommonPeriod) or the
+// positions jump when the table wraps. EvaluateScalar skips the SSE path, to check it against.
+
+class Ephemeris {
+public:
+    static const int MAX_COEFFICIENTS = 32, LANES = 4;
+    typedef std::function<void(size_t, GLdouble, GLfloat *)> Model;
+
+    struct Header {
+        char magic[4];
+        GLuint version;
+        GLuint bodies;
+        GLuint segments;
+        GLuint coefficients;
+        GLuint reserved;
+        GLdouble duration;
+    };
+
+private:
+    size_t bodies_;
+    size_t segments_;
+    int coefficients_;
+    GLdouble duration_;
+    GLdouble span_;
+    std::vector<GLfloat> table_;
+
+    const GLfloat * locate(GLdouble seconds, GLfloat & x) const;
+    static void clenshaw(const GLfloat * series, int count, GLfloat x, GLfloat * position);
+    static void clenshawScalar(const GLfloat * series, int count, GLfloat x, GLfloat * position);
+
+public:
+    Ephemeris();
+
+    inline size_t Bodies() const { return bodies_; }
+    inline size_t Segments() const { return segments_; }
+    inline int Coefficients() const { return coefficients_; }
+    inline GLdouble Duration() const { return duration_; }
+    inline bool IsEmpty() const { return table_.empty(); }
+
+    static GLdouble CommonPeriod(const GLdouble * periods, size_t count, int maxTurns = 64);
+
+    void Fit(size_t bodies, GLdouble duration, size_t segments, int coefficients, const Model & model);
+    void Evaluate(size_t body, GLdouble seconds, GLfloat * position) const;
+    void Evaluate(GLdouble seconds, GLfloat * positions) const;
+    void EvaluateScalar(size_t body, GLdouble seconds, GLfloat * position) const;
+    bool Load(const char * path);
+    bool Save(const char * path) const;
+    void Clear();
+};
+
+//****************************************************************************************************
+//******************************************** Parallelism *******************************************
+//****************************************************************************************************
+
+//----------------------------------------------------------------------------------------------------
+// ThreadPool
+//----------------------------------------------------------------------------------------------------
+
+// Workers that split a range of indices in chunks of at least grain elements. The calling thread also
+// takes chunks, and ParallelFor returns when the whole range is done. Small ranges are run directly.
+
+class ThreadPool {
+public:
+    typedef std::function<void(size_t, size_t)> Body;
+
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const Body * body_;
+    size_t count_;
+    size_t chunk_;
+    std::atomic<size_t> next_;
+    size_t pending_;
+    size_t generation_;
+    bool stop_;
+
+    void work();
+    void runChunks();
+
+public:
+    ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    inline size_t Size() const { return workers_.size() + 1; }
+
+    void ParallelFor(size_t count, size_t grain, const Body & body);
+
+    static ThreadPool & Shared();
+};
+
+//****************************************************************************************************
+//********************************************** Physics *********************************************
+//****************************************************************************************************
+
+//----------------------------------------------------------------------------------------------------
+// GravitySystem
+//----------------------------------------------------------------------------------------------------
+
+// Bodies under their mutual gravity, integrated with a leapfrog (kick-drift-kick), so the energy
+// doesn't drift away over long runs. The forces use a Barnes-Hut octree, rebuilt in every step from
+// the bodies sorted by their Morton codes, and the far cells are replaced by their center of mass when
+// they are seen under an angle smaller than theta. The force pass is spread over a thread pool, taking
+// the bodies in tree order, so the threads walk close parts of the tree. A body whose position or
+// velocity stops being finite (a very close encounter or a huge step) is lost: it's left still at the
+// origin without mass, so it can't spoil the tree or the rest of the bodies.
+
+class GravitySystem {
+public:
+    static const int LEAF_BODIES = 16, MAX_DEPTH = 21;
+
+    struct Cell {
+        GLfloat x, y, z, mass;
+        GLfloat size;
+        GLuint first;
+        GLuint count;
+        GLuint children;
+    };
+
+private:
+    GLfloat constant_;
+    GLfloat theta_;
+    GLfloat softening_;
+    std::vector<GLfloat> px_, py_, pz_;
+    std::vector<GLfloat> vx_, vy_, vz_;
+    std::vector<GLfloat> ax_, ay_, az_;
+    std::vector<GLfloat> masses_;
+    std::vector<std::pair<uint64_t, GLuint>> keys_;
+    std::vector<GLfloat> sorted_;
+    std::vector<Cell> cells_;
+    size_t lost_;
+    bool ready_;
+
+    void removeInvalid(ThreadPool & pool);
+    void buildCell(GLuint index, size_t begin, size_t end, int depth, GLfloat size);
+    void accelerate(size_t begin, size_t end);
+    void computeAccelerations(ThreadPool & pool);
+
+public:
+    GravitySystem();
+
+    inline size_t Size() const { return masses_.size(); }
+    inline size_t Cells() const { return cells_.size(); }
+    inline size_t Lost() const { return lost_; }
+    inline GLfloat GetConstant() const { return constant_; }
+    inline GLfloat GetTheta() const { return theta_; }
+    inline GLfloat GetSoftening() const { return softening_; }
+
+    void SetConstant(GLfloat value);
+    void SetTheta(GLfloat value);
+    void SetSoftening(GLfloat value);
+
+    size_t Add(const GLfloat * position, const GLfloat * velocity, GLfloat mass);
+    void GetPosition(size_t body, GLfloat * position) const;
+    void GetVelocity(size_t body, GLfloat * velocity) const;
+    void GetAcceleration(size_t body, GLfloat * acceleration, ThreadPool & pool);
+    void Step(GLfloat seconds, ThreadPool & pool);
+    void ZeroMomentum();
+    GLdouble Energy() const;
+    void Clear();
+};
+
+//****************************************************************************************************
+//************************************************ Sky ***********************************************
+//****************************************************************************************************
+
+//----------------------------------------------------------------------------------------------------
+// MappedFile
+//----------------------------------------------------------------------------------------------------
+
+// Read-only view of a whole file mapped in memory, with MapViewOfFile in Windows and mmap elsewhere.
+
+class MappedFile {
+private:
+    const void * data_;
+    size_t size_;
+#ifdef _WIN32
+    HANDLE file_;
+    HANDLE mapping_;
+#else
+    int file_;
+#endif
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator = (const MappedFile &) = delete;
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    inline const void * Data() const { return data_; }
+    inline size_t Size() const { return size_; }
+    inline bool IsOpen() const { return data_ != nullptr; }
+
+    bool Open(const char * path);
+    void Close();
+};
+
+//----------------------------------------------------------------------------------------------------
+// StarCatalog
+//----------------------------------------------------------------------------------------------------
+
+// Binary catalog of stars: a header, a table of sky tiles and the stars sorted by tile and magnitude.
+// The sky is split as a cube, with a grid of TILE_SIDE x TILE_SIDE tiles on each face, and each tile
+// has the count of its stars in every magnitude band. The records of the stars are used directly as
+// a vertex array (the direction and the color, already scaled by the brightness), so a catalog read
+// from a mapped file isn't copied. The catalog is stored with the byte order of the machine.
+
+struct StarRecord {
+    GLfloat direction[3];
+    GLubyte color[3];
+    GLbyte magnitude;
+};
+
+class StarCatalog {
+public:
+    static const int TILE_SIDE = 8, TILE_COUNT = 6 * TILE_SIDE * TILE_SIDE, BANDS = 3;
+    static const GLuint VERSION = 1;
+    static const GLfloat BAND_LIMITS[BANDS - 1];
+
+    struct Header {
+        char magic[4];
+        GLuint version;
+        GLuint count;
+        GLuint tiles;
+    };
+
+    struct Tile {
+        GLuint first;
+        GLuint counts[BANDS];
+    };
+
+private:
+    MappedFile file_;
+    std::vector<char> buffer_;
+    const Header * header_;
+    const Tile * tiles_;
+    const StarRecord * stars_;
+
+    bool bind(const char * data, size_t size);
+
+public:
+    StarCatalog();
+
+    inline bool IsLoaded() const { return header_ != nullptr; }
+    inline size_t Size() const { return header_ ? header_->count : 0; }
+    inline const Tile & GetTile(int index) const { return tiles_[index]; }
+    inline const StarRecord * GetStars() const { return stars_; }
+    inline const void * GetData() const { return header_; }
+
+    bool Load(const char * path);
+    void Build(const std::vector<StarRecord> & stars);
+    void Generate(size_t count, GLfloat maxMagnitude, unsigned int seed);
+    bool Save(const char * path) const;
+    void Clear();
+
+    static int TileOf(const GLfloat * direction);
+    static int BandOf(GLfloat magnitude);
+    static void TileCorner(int tile, GLfloat u, GLfloat v, GLfloat * direction);
+};
+
+//----------------------------------------------------------------------------------------------------
+// StarField
+//----------------------------------------------------------------------------------------------------
+
+// Background of stars at an infinite distance, drawn with the rotation of the camera on a sphere of
+// DISTANCE units. The catalog is loaded in another thread, so the first frames are drawn without it,
+// and its pages are touched once to load them before it's ready. Every tile is culled with its
+// bounding sphere, and the bands are drawn as points of different sizes.
+
+class StarField {
+public:
+    static const GLfloat DISTANCE;
+    static const GLfloat POINT_SIZES[StarCatalog::BANDS];
+
+private:
+    StarCatalog catalog_;
+    std::thread loader_;
+    std::atomic<bool> ready_;
+    Point3 centers_[StarCatalog::TILE_COUNT];
+    GLfloat radii_[StarCatalog::TILE_COUNT];
+    size_t drawnTiles_, drawnStars_;
+
+    void load(std::string path, size_t count, GLfloat maxMagnitude, unsigned int seed);
+
+public:
+    StarField();
+    ~StarField();
+
+    inline bool IsReady() const { return ready_.load(std::memory_order_acquire); }
+    inline size_t Size() const { return IsReady() ? catalog_.Size() : 0; }
+    inline size_t GetDrawnTiles() const { return drawnTiles_; }
+    inline size_t GetDrawnStars() const { return drawnStars_; }
+
+    void LoadAsync(const char * path, size_t count, GLfloat maxMagnitude, unsigned int seed);
+    void Draw(const Matrix & projection, const Matrix & rotation);
 };
 
 #endif
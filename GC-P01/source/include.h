@@ -45,6 +45,38 @@ const GLsizei WINDOW_WIDTH = 800, WINDOW_HEIGHT = 600;
 const GLfloat CAMERA_INC = 10.0f;
 const GLdouble NEAR_PLANE = 0.5, FAR_PLANE = 1000.0, FOVY = 45.0;
 
+const GLdouble TICK_RATE = 25.0, MIN_TICK_RATE = 5.0, MAX_TICK_RATE = 200.0;
+const int MAX_CATCH_UP_STEPS = 8;
+const unsigned int FRAME_INTERVAL = 16;
+const GLdouble MIN_TIME_SCALE = 0.0625, MAX_TIME_SCALE = 64.0, JUMP_SECONDS = 10.0;
+
+const GLdouble EARTH_ORBIT_SPEED = 25.0, EARTH_SPIN_SPEED = 50.0;
+const GLdouble MOON_ORBIT_SPEED = 100.0, MOON_SPIN_SPEED = 100.0;
+const GLdouble SATELLITE_ORBIT_SPEED = 200.0, SATELLITE_SPIN_SPEED = 200.0;
+
+const size_t CONSTELLATION_SIZE = 10000;
+const unsigned int CONSTELLATION_SEED = 2015;
+const GLfloat CONSTELLATION_MODEL_SIZE = 0.25f, CONSTELLATION_SPEED = 120.0f;
+const GLfloat CONSTELLATION_MIN_RADIUS = 12.0f, CONSTELLATION_MAX_RADIUS = 20.0f;
+
+const size_t BELT_SIZE = 100000;
+const unsigned int BELT_SEED = 1801;
+const GLfloat BELT_MIN_RADIUS = 95.0f, BELT_MAX_RADIUS = 130.0f, BELT_THICKNESS = 4.0f, BELT_SPEED = 10.0f;
+
+const GLfloat GRAVITY_THETA = 0.7f, GRAVITY_SOFTENING = 0.5f;
+const GLfloat EARTH_MASS_RATIO = 0.003f, BELT_MASS_RATIO = 0.001f;
+
+const char * const EPHEMERIS_FILE = "ephemeris.bin";
+const size_t EPHEMERIS_BODIES = 2, EPHEMERIS_SEGMENTS = 64;
+const int EPHEMERIS_COEFFICIENTS = 10;
+const GLdouble EARTH_ECCENTRICITY = 0.2, EARTH_INCLINATION = 5.0, EARTH_PERIAPSIS = 0.0;
+const GLdouble MOON_ECCENTRICITY = 0.3, MOON_INCLINATION = 15.0, MOON_PERIAPSIS = 45.0;
+
+const char * const STARS_FILE = "stars.bin";
+const size_t STARS_SIZE = 300000;
+const unsigned int STARS_SEED = 1054;
+const GLfloat STARS_MAX_MAGNITUDE = 9.0f;
+
 const GLfloat CAMERA_EYE_XI = 100.0f, CAMERA_EYE_YI = 100.0f, CAMERA_EYE_ZI = 100.0f;
 const GLfloat CAMERA_EYE_XX = 100.0f, CAMERA_EYE_YX =   0.0f, CAMERA_EYE_ZX =   0.0f;
 const GLfloat CAMERA_EYE_XY =   0.0f, CAMERA_EYE_YY = 100.0f, CAMERA_EYE_ZY =   0.0f;
@@ -23,6 +23,22 @@
 #include "render.h"
 #include "data.h"
 
+//****************************************************************************************************
+// Statistics
+//****************************************************************************************************
+
+// The F7 stats are added up every frame and printed once per second, writing them every frame
+// would take more time than the frame itself:
+struct RenderStats {
+    GLdouble start = -1.0;
+    unsigned long frames = 0, updates = 0, maxSteps = 0;
+    unsigned long recomputed = 0, reused = 0, drawn = 0, culled = 0;
+    unsigned long rocks = 0, points = 0, rocksCulled = 0;
+    unsigned long stars = 0, tiles = 0, issued = 0, skipped = 0;
+};
+
+static RenderStats FrameStats;
+
 //****************************************************************************************************
 // Initialization Functions
 //****************************************************************************************************
@@ -58,6 +74,9 @@ void InitializeGL () {
     glLightModelfv(GL_LIGHT_MODEL_AMBIENT, AMBIENT_COLOR);
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
 
+    // The state above was set directly, so the cache has to forget anything it knew:
+    GLState::Invalidate();
+
     glViewport(0, 0, WindowWidth, WindowHeight);
     InitializeProjection();
     SetCameraAtInitial();
@@ -66,16 +85,18 @@ void InitializeGL () {
 //----------------------------------------------------------------------------------------------------
 
 void InitializeProjection () {
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
+    // The same matrix is used to build the frustum for the culling:
     if (UseOrtho) {
-        GLdouble x = (WindowWidth * 0.5) / CurrentScale;
-        GLdouble y = (WindowHeight * 0.5) / CurrentScale;
-        glOrtho(-x, x, -y, y, NEAR_PLANE, FAR_PLANE);
+        GLfloat x = (GLfloat)((WindowWidth * 0.5) / CurrentScale);
+        GLfloat y = (GLfloat)((WindowHeight * 0.5) / CurrentScale);
+        ProjectionMatrix.SetAsOrtho(-x, x, -y, y, (GLfloat)NEAR_PLANE, (GLfloat)FAR_PLANE);
     } else {
-        GLdouble aspect = (GLdouble)WindowWidth / (GLdouble)WindowHeight;
-        gluPerspective(FOVY / CurrentScale, aspect, NEAR_PLANE, FAR_PLANE);
+        GLfloat aspect = (GLfloat)WindowWidth / (GLfloat)WindowHeight;
+        ProjectionMatrix.SetAsPerspective((GLfloat)(FOVY / CurrentScale), aspect,
+            (GLfloat)NEAR_PLANE, (GLfloat)FAR_PLANE);
     }
+    glMatrixMode(GL_PROJECTION);
+    ProjectionMatrix.LoadInOpenGL();
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -106,13 +127,134 @@ void InitializeScene () {
         MoonSphere.GetMaterial().SetTexture(MoonTexture.Name());
     }
 
+    SunSphere.ClearChildrens();
     SunSphere.AddChildren(&EarthOrbit);
     SunSphere.AddChildren(&EarthSphere);
+    SunSphere.AddChildren(&AsteroidBelt);
 
+    EarthSphere.ClearChildrens();
     EarthSphere.AddChildren(&MoonOrbit);
     EarthSphere.AddChildren(&MoonSphere);
     EarthSphere.AddChildren(&SatelliteOrbit);
     EarthSphere.AddChildren(&HumanSatellite);
+    EarthSphere.AddChildren(&SatelliteSwarm);
+
+    EarthSphere.SetOrbitMotion(AngularMotion(EARTH_ORBIT_SPEED));
+    EarthSphere.SetSpinMotion(AngularMotion(EARTH_SPIN_SPEED));
+    MoonSphere.SetOrbitMotion(AngularMotion(MOON_ORBIT_SPEED));
+    MoonSphere.SetSpinMotion(AngularMotion(MOON_SPIN_SPEED));
+    HumanSatellite.SetOrbitMotion(AngularMotion(SATELLITE_ORBIT_SPEED));
+    HumanSatellite.SetSpinMotion(AngularMotion(SATELLITE_SPIN_SPEED));
+
+    SolarScene.Compile(&SunSphere);
+    PreviousTime = CurrentTime = 0.0;
+    SolarGravity.Clear();
+    UpdateConstellation();
+    UpdateBelt();
+    UpdateEphemeris();
+    ApplySimulationTime(1.0);
+    UpdateGravity();
+
+    // The stars are loaded only once, the first frames are drawn without them:
+    SkyStars.LoadAsync(STARS_FILE, STARS_SIZE, STARS_MAX_MAGNITUDE, STARS_SEED);
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void UpdateConstellation () {
+    if (UseConstellation) {
+        SatelliteSwarm.Generate(CONSTELLATION_SIZE, CONSTELLATION_MIN_RADIUS, CONSTELLATION_MAX_RADIUS,
+            CONSTELLATION_SPEED, CONSTELLATION_SEED);
+        SatelliteSwarm.SetTime(CurrentTime);
+    } else {
+        SatelliteSwarm.Initialize();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void UpdateBelt () {
+    if (UseBelt) {
+        AsteroidBelt.Generate(BELT_SIZE, BELT_MIN_RADIUS, BELT_MAX_RADIUS, BELT_THICKNESS, BELT_SPEED, BELT_SEED);
+        AsteroidBelt.GetMaterial().SetColor(0.45f, 0.4f, 0.35f);
+        AsteroidBelt.SetTime(CurrentTime);
+    } else {
+        AsteroidBelt.Initialize();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void UpdateEphemeris () {
+    // The table is read from a file when there is one, otherwise it's fitted from the orbits. It wraps
+    // after its duration, so it must be a common period of both orbits, and without one it stays empty:
+    if (SolarEphemeris.IsEmpty()) {
+        const KeplerOrbit * orbits[] = { &EarthKepler, &MoonKepler };
+        const GLdouble periods[] = { EarthKepler.period, MoonKepler.period };
+        GLdouble duration = Ephemeris::CommonPeriod(periods, EPHEMERIS_BODIES);
+        if (duration > 0.0 && (!SolarEphemeris.Load(EPHEMERIS_FILE) ||
+            SolarEphemeris.Bodies() != EPHEMERIS_BODIES || SolarEphemeris.Duration() != duration)) {
+            SolarEphemeris.Fit(EPHEMERIS_BODIES, duration, EPHEMERIS_SEGMENTS, EPHEMERIS_COEFFICIENTS,
+                [&orbits] (size_t body, GLdouble seconds, GLfloat * position) {
+                    orbits[body]->Position(seconds, position);
+                });
+        }
+    }
+    if (!UseEphemeris) {
+        EarthSphere.ClearPosition();
+        MoonSphere.ClearPosition();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+static void AddOrbitingBody (const GLfloat * position, GLfloat mass, GLfloat sunMass) {
+    // Circular speed around the Sun, in the same direction of the kinematic orbits:
+    GLfloat radius = std::sqrt(position[0] * position[0] + position[2] * position[2]);
+    GLfloat factor = std::sqrt(SolarGravity.GetConstant() * sunMass / radius) / radius;
+    GLfloat velocity[3] = { position[2] * factor, 0.0f, -position[0] * factor };
+    SolarGravity.Add(position, velocity, mass);
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void UpdateGravity () {
+    // The bodies under the Sun start from the scene as it is now, the Moon and the satellites
+    // keep their orbits around the Earth:
+    bool active = SolarGravity.Size() > 0;
+    SolarGravity.Clear();
+    SunSphere.ClearPosition();
+    AsteroidBelt.SetKinematic(!UseGravity);
+    if (!UseGravity) {
+        // The physics moved the heights of the belt, so it's made again:
+        if (active) UpdateBelt();
+        UpdateEphemeris();
+        ApplySimulationTime(1.0);
+        return;
+    }
+
+    // The mass of the Sun keeps the period of the Earth (Kepler's third law gives G M):
+    const GLfloat ORIGIN[3] = { 0.0f, 0.0f, 0.0f };
+    GLdouble period = EarthKepler.period, distance = EarthKepler.semiMajor;
+    GLfloat sunMass = static_cast<GLfloat>(4.0 * PI * PI * distance * distance * distance / (period * period) /
+        SolarGravity.GetConstant());
+    SolarGravity.SetTheta(GRAVITY_THETA);
+    SolarGravity.SetSoftening(GRAVITY_SOFTENING);
+    SolarGravity.Add(ORIGIN, ORIGIN, sunMass);
+
+    Matrix local;
+    EarthSphere.GetLocalMatrix(local);
+    AddOrbitingBody(local.Get() + 12, sunMass * EARTH_MASS_RATIO, sunMass);
+
+    size_t size = AsteroidBelt.Size();
+    GLfloat rockMass = size ? sunMass * BELT_MASS_RATIO / size : 0.0f;
+    for (size_t i = 0; i < size; ++i) {
+        GLfloat position[3];
+        AsteroidBelt.GetPosition(i, position);
+        AddOrbitingBody(position, rockMass, sunMass);
+    }
+    SolarGravity.ZeroMomentum();
+    ApplySimulationTime(1.0);
 }
 
 //----------------------------------------------------------------------------------------------------
@@ -123,10 +265,18 @@ void ResetConfiguration () {
     UseOneVP = true;
     UseTimer = false;
     UseAxes  = true;
+    UseStats = false;
+    UseConstellation = false;
+    UseBelt = false;
+    UseStars = true;
+    UseEphemeris = false;
+    UseGravity = false;
     UpdateMVPConfiguration();
     glViewport(0, 0, WindowWidth, WindowHeight);
     InitializeProjection();
     SetCameraAtInitial();
+    MainClock.SetTickRate(TICK_RATE);
+    TimeScale = 1.0;
     InitializeScene();
 }
 
@@ -145,28 +295,144 @@ void UpdateMVPConfiguration () {
 
 void DrawScene () {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLState::ResetCounters();
     glMatrixMode(GL_MODELVIEW);
-    if (UseAxes) MainAxes.Draw();
-    SunSphere.Draw();
+    DrawStarField();
+    DrawAxes();
+    UpdateScene();
+    DrawSolarScene(WindowHeight);
+    ReportGLState();
 }
 
 //----------------------------------------------------------------------------------------------------
 
 void DrawScene4xN () {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLState::ResetCounters();
     GLint x, y;
+    UpdateScene();
+    // Every tile has the same camera and projection, so the scene is culled and sorted once:
+    InitializeProjection();
+    glMatrixMode(GL_MODELVIEW);
+    PrepareSolarScene(WindowHeight4);
     for (GLint i = 0; i < WindowRows; ++i) {
         for (GLint j = 0; j < WindowColumns; ++j) {
             x = j * WindowWidth4, y = i * WindowHeight4;
             glScissor(x, y, WindowWidth4, WindowHeight4);
             glViewport(x, y, WindowWidth4, WindowHeight4);
-            InitializeProjection();
-            glMatrixMode(GL_MODELVIEW);
-            if (UseAxes) MainAxes.Draw();
-            SunSphere.Draw();
+            DrawStarField();
+            DrawAxes();
+            SolarScene.Submit();
         }
     }
     glScissor(0, 0, WindowWidth, WindowHeight);
+    ReportGLState();
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void UpdateScene () {
+    SolarScene.Update();
+    if (UseStats) {
+        FrameStats.recomputed += SolarScene.GetRecomputed();
+        FrameStats.reused += SolarScene.GetReused();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void DrawAxes () {
+    // The axes never change, so they are recorded only once:
+    if (!UseAxes) return;
+    if (!AxesCommands.Name()) {
+        AxesCommands.Begin();
+            MainAxes.Draw();
+        AxesCommands.End();
+    }
+    AxesCommands.Call();
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void DrawSolarScene (GLsizei viewportHeight) {
+    PrepareSolarScene(viewportHeight);
+    SolarScene.Submit();
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void PrepareSolarScene (GLsizei viewportHeight) {
+    SolarScene.Prepare(SceneView(ProjectionMatrix, MainCamera.GetViewMatrix(), viewportHeight));
+    if (UseStats) {
+        FrameStats.drawn += SolarScene.GetDrawn();
+        FrameStats.culled += SolarScene.GetCulled();
+        if (UseBelt) {
+            FrameStats.rocks += AsteroidBelt.GetRocks();
+            FrameStats.points += AsteroidBelt.GetPoints();
+            FrameStats.rocksCulled += AsteroidBelt.GetCulled();
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void DrawStarField () {
+    // The sky is at an infinite distance, so it uses a perspective projection and only the rotation
+    // of the camera, even with the orthographic projection:
+    if (!UseStars) return;
+    Matrix projection, rotation = MainCamera.GetViewMatrix();
+    GLfloat aspect = (GLfloat)WindowWidth / (GLfloat)WindowHeight;
+    projection.SetAsPerspective((GLfloat)(FOVY / CurrentScale), aspect, (GLfloat)NEAR_PLANE, (GLfloat)FAR_PLANE);
+    rotation.Set(0, 3, 0.0f);
+    rotation.Set(1, 3, 0.0f);
+    rotation.Set(2, 3, 0.0f);
+    SkyStars.Draw(projection, rotation);
+    if (UseStats) {
+        FrameStats.stars += SkyStars.GetDrawnStars();
+        FrameStats.tiles += SkyStars.GetDrawnTiles();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void ReportGLState () {
+    // The frame is over, so the counters are added and, once per second, printed as averages:
+    if (!UseStats) {
+        FrameStats = RenderStats();
+        return;
+    }
+    GLdouble now = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
+    if (FrameStats.start < 0.0) FrameStats.start = now;
+    FrameStats.issued += GLState::Issued();
+    FrameStats.skipped += GLState::Skipped();
+    ++FrameStats.frames;
+    GLdouble elapsed = now - FrameStats.start;
+    if (elapsed < 1.0) return;
+    const RenderStats & s = FrameStats;
+    unsigned long n = s.frames;
+    std::cout << "Frames per second: " << n / elapsed << '\n'
+              << "Nodes recomputed: " << s.recomputed / n << ", reused: " << s.reused / n << '\n'
+              << "Nodes drawn: " << s.drawn / n << ", culled: " << s.culled / n << '\n';
+    if (UseBelt) {
+        std::cout << "Belt rocks: " << s.rocks / n << ", points: " << s.points / n
+                  << ", culled: " << s.rocksCulled / n << '\n';
+    }
+    if (UseGravity) {
+        std::cout << "Gravity bodies: " << SolarGravity.Size() << ", cells: " << SolarGravity.Cells()
+                  << ", lost: " << SolarGravity.Lost() << '\n';
+    }
+    if (UseStars) {
+        std::cout << "Stars drawn: " << s.stars / n << " of " << SkyStars.Size()
+                  << ", tiles: " << s.tiles / n << '\n';
+    }
+    if (s.updates) {
+        std::cout << "Ticks per second: " << MainClock.GetMeasuredRate()
+                  << " (" << MainClock.GetTickRate() << "), max catch-up steps: " << s.maxSteps
+                  << ", time: " << CurrentTime << " (x" << TimeScale << ")" << '\n';
+    }
+    std::cout << "GL calls issued: " << s.issued / n << ", skipped: " << s.skipped / n << std::endl;
+    FrameStats = RenderStats();
+    FrameStats.start = now;
 }
 
 //****************************************************************************************************
@@ -174,12 +440,91 @@ void DrawScene4xN () {
 //****************************************************************************************************
 
 void OneStepRotation () {
-    EarthSphere.AddOrbitRotation(1.0);
-    EarthSphere.AddRotation(2.0);
-    MoonSphere.AddOrbitRotation(4.0);
-    MoonSphere.AddRotation(4.0);
-    HumanSatellite.AddOrbitRotation(8.0);
-    HumanSatellite.AddRotation(8.0);
+    // A single tick of the simulation, the nodes are moved by ApplySimulationTime:
+    PreviousTime = CurrentTime;
+    CurrentTime += MainClock.GetTickSeconds() * TimeScale;
+    if (UseGravity) {
+        SolarGravity.Step(static_cast<GLfloat>(MainClock.GetTickSeconds() * TimeScale), ThreadPool::Shared());
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void ApplySimulationTime (GLdouble alpha) {
+    // The state is a function of the time, so the interpolation is exact:
+    GLdouble seconds = PreviousTime + (CurrentTime - PreviousTime) * alpha;
+    SolarScene.SetTime(seconds);
+    if (UseEphemeris && !SolarEphemeris.IsEmpty()) {
+        GLfloat positions[EPHEMERIS_BODIES * Ephemeris::LANES];
+        SolarEphemeris.Evaluate(seconds, positions);
+        EarthSphere.SetPosition(positions);
+        MoonSphere.SetPosition(positions + Ephemeris::LANES);
+    }
+    if (UseGravity && SolarGravity.Size()) {
+        // The physics has only the last step, and the positions are relative to the Sun:
+        GLfloat sun[3], position[3];
+        SolarGravity.GetPosition(0, sun);
+        SunSphere.SetPosition(sun);
+        SolarGravity.GetPosition(1, position);
+        for (int a = 0; a < 3; ++a) position[a] -= sun[a];
+        EarthSphere.SetPosition(position);
+        size_t size = AsteroidBelt.Size() < SolarGravity.Size() - 2 ? AsteroidBelt.Size() : SolarGravity.Size() - 2;
+        for (size_t i = 0; i < size; ++i) {
+            SolarGravity.GetPosition(i + 2, position);
+            for (int a = 0; a < 3; ++a) position[a] -= sun[a];
+            AsteroidBelt.SetPosition(i, position);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void JumpSimulationTime (GLdouble seconds) {
+    // The physics can only be stepped, and a jump would take hundreds of steps:
+    if (UseGravity) return;
+    PreviousTime = CurrentTime = CurrentTime + seconds;
+    ApplySimulationTime(1.0);
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void ChangeTimeScale (GLdouble factor) {
+    GLdouble scale = TimeScale * factor, size = std::fabs(scale);
+    if (MIN_TIME_SCALE <= size && size <= MAX_TIME_SCALE) {
+        TimeScale = scale;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void StartSimulation () {
+    MainClock.Reset(glutGet(GLUT_ELAPSED_TIME) / 1000.0);
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void UpdateSimulation () {
+    if (UseTimer) {
+        GLint steps = MainClock.Advance(glutGet(GLUT_ELAPSED_TIME) / 1000.0);
+        for (GLint i = 0; i < steps; ++i) {
+            OneStepRotation();
+        }
+        ApplySimulationTime(MainClock.GetAlpha());
+        if (UseStats) {
+            unsigned long count = static_cast<unsigned long>(MainClock.GetSteps());
+            FrameStats.maxSteps = count > FrameStats.maxSteps ? count : FrameStats.maxSteps;
+            ++FrameStats.updates;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void ChangeTickRate (GLdouble factor) {
+    GLdouble rate = MainClock.GetTickRate() * factor;
+    if (MIN_TICK_RATE <= rate && rate <= MAX_TICK_RATE) {
+        MainClock.SetTickRate(rate);
+    }
 }
 
 //****************************************************************************************************
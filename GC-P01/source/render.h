@@ -28,13 +28,29 @@
 void InitializeGL ();
 void InitializeProjection ();
 void InitializeScene ();
+void UpdateConstellation ();
+void UpdateBelt ();
+void UpdateEphemeris ();
+void UpdateGravity ();
 void ResetConfiguration ();
 void UpdateMVPConfiguration ();
 
 void DrawScene ();
 void DrawScene4xN ();
+void UpdateScene ();
+void DrawAxes ();
+void PrepareSolarScene (GLsizei viewportHeight);
+void DrawSolarScene (GLsizei viewportHeight);
+void DrawStarField ();
+void ReportGLState ();
 
 void OneStepRotation ();
+void ApplySimulationTime (GLdouble alpha);
+void JumpSimulationTime (GLdouble seconds);
+void ChangeTimeScale (GLdouble factor);
+void StartSimulation ();
+void UpdateSimulation ();
+void ChangeTickRate (GLdouble factor);
 
 void SetCameraAtInitial ();
 void SetCameraAtX ();
@@ -85,6 +85,19 @@ public:
     }
 };
 
+//----------------------------------------------------------------------------------------------------
+// BoxData3D
+//----------------------------------------------------------------------------------------------------
+
+// Vertices, faces and normals of a box, Generator3D::BoxData can fill it at compile time.
+
+struct BoxData3D {
+    static const GLuint VERTICES = 8, FACES = 6, SIDES = 4;
+    Vector3D vertex[VERTICES];
+    GLuint face[FACES][SIDES];
+    Vector3D normal[FACES];
+};
+
 //----------------------------------------------------------------------------------------------------
 // Generator3D
 //----------------------------------------------------------------------------------------------------
@@ -97,15 +110,14 @@ public:
         GLfloat currentAngle = 0.0f, angleStep = 2.0f * PI / static_cast<GLfloat>(slices);
 
         // Calculate vertices and faces of the figure:
-        std::vector<Vector3D> vertex;
-        std::vector<FaceWithNormal3D> face;
         auto size = outline.Data().size();
+        std::vector<Vector3D> vertex(slices * size);
+        std::vector<FaceWithNormal3D> face;
+        face.reserve(slices * size + 2);
         for (GLuint i = 0; i < slices; ++i) {
             // vertices of the figure:
             transform.SetAsRotateY(currentAngle);
-            std::for_each(outline.Begin(), outline.End(), [&] (const Vector3D & item) {
-                vertex.push_back(transform * item);
-            });
+            transform.Transform(outline.Data().data(), &vertex[i * size], size);
             currentAngle += angleStep;
             // Faces of the figure:
             GLuint leftBase = i * size, rightBase = ((i + 1) % slices) * size;
@@ -137,56 +149,38 @@ public:
         return result;
     }
 
-    static SimpleMesh3D SimpleBox(GLfloat length) {
+    static constexpr BoxData3D BoxData(GLfloat length) {
         // Calculate vertices and faces of the figure:
         GLfloat halfSide = length / 2.0f;
-        std::vector<Vector3D> vertex;
-        std::vector<FaceWithNormal3D> face;
-
-        vertex.push_back(Vector3D(-halfSide, halfSide, halfSide));
-        vertex.push_back(Vector3D(-halfSide, -halfSide, halfSide));
-        vertex.push_back(Vector3D(halfSide, -halfSide, halfSide));
-        vertex.push_back(Vector3D(halfSide, halfSide, halfSide));
-        vertex.push_back(Vector3D(-halfSide, halfSide, -halfSide));
-        vertex.push_back(Vector3D(-halfSide, -halfSide, -halfSide));
-        vertex.push_back(Vector3D(halfSide, -halfSide, -halfSide));
-        vertex.push_back(Vector3D(halfSide, halfSide, -halfSide));
-
-        std::vector<GLuint> idx;
-        idx.push_back(0); idx.push_back(1);
-        idx.push_back(2); idx.push_back(3);
-        face.push_back(FaceWithNormal3D(idx));
-
-        idx.clear();
-        idx.push_back(7); idx.push_back(6);
-        idx.push_back(5); idx.push_back(4);
-        face.push_back(FaceWithNormal3D(idx));
-
-        idx.clear();
-        idx.push_back(3); idx.push_back(2);
-        idx.push_back(6); idx.push_back(7);
-        face.push_back(FaceWithNormal3D(idx));
-
-        idx.clear();
-        idx.push_back(4); idx.push_back(5);
-        idx.push_back(1); idx.push_back(0);
-        face.push_back(FaceWithNormal3D(idx));
-
-        idx.clear();
-        idx.push_back(0); idx.push_back(3);
-        idx.push_back(7); idx.push_back(4);
-        face.push_back(FaceWithNormal3D(idx));
-
-        idx.clear();
-        idx.push_back(1); idx.push_back(5);
-        idx.push_back(6); idx.push_back(2);
-        face.push_back(FaceWithNormal3D(idx));
-
-        // Configure & return the final model:
-        SimpleMesh3D result(vertex, face);
-        result.CalculateNormals();
+        BoxData3D result {
+            {
+                Vector3D(-halfSide, halfSide, halfSide), Vector3D(-halfSide, -halfSide, halfSide),
+                Vector3D(halfSide, -halfSide, halfSide), Vector3D(halfSide, halfSide, halfSide),
+                Vector3D(-halfSide, halfSide, -halfSide), Vector3D(-halfSide, -halfSide, -halfSide),
+                Vector3D(halfSide, -halfSide, -halfSide), Vector3D(halfSide, halfSide, -halfSide)
+            },
+            { { 0, 1, 2, 3 }, { 7, 6, 5, 4 }, { 3, 2, 6, 7 }, { 4, 5, 1, 0 }, { 0, 3, 7, 4 }, { 1, 5, 6, 2 } },
+            {}
+        };
+
+        // Calculate the normals of the faces:
+        for (GLuint i = 0; i < BoxData3D::FACES; ++i) {
+            result.normal[i] = NewellNormal(result.vertex, result.face[i], BoxData3D::SIDES);
+        }
         return result;
     }
+
+    static SimpleMesh3D SimpleBox(GLfloat length) {
+        // Copy the data of the box into a mesh:
+        BoxData3D box = BoxData(length);
+        std::vector<Vector3D> vertex(std::begin(box.vertex), std::end(box.vertex));
+        std::vector<FaceWithNormal3D> face;
+        for (GLuint i = 0; i < BoxData3D::FACES; ++i) {
+            std::vector<GLuint> idx(std::begin(box.face[i]), std::end(box.face[i]));
+            face.push_back(FaceWithNormal3D(idx, box.normal[i]));
+        }
+        return SimpleMesh3D(vertex, face);
+    }
 };
 
 #endif
@@ -27,7 +27,20 @@
 #include <Windows.h>
 #include <gl/GL.h>
 #include <cstring>
+#include <cstddef>
 #include <cmath>
+#include <vector>
+#include "../../GC-Common/source/gtrig.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define GMATH_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define GMATH_AVX
+#include <immintrin.h>
+#endif
 
 class Matrix;
 
@@ -35,13 +48,52 @@ class Matrix;
 // General
 //----------------------------------------------------------------------------------------------------
 
-const GLfloat PI = 3.14159265359f;
-const GLfloat W_AS_VECTOR = 0.0f;
-const GLfloat W_AS_POINT = 1.0f;
-const GLfloat W_THRESHOLD = 0.01f;
+constexpr GLfloat PI = 3.14159265359f;
+constexpr GLfloat W_AS_VECTOR = 0.0f;
+constexpr GLfloat W_AS_POINT = 1.0f;
+constexpr GLfloat W_THRESHOLD = 0.01f;
+
+constexpr GLfloat RadToDeg(GLfloat value) { return (value * 180.0f) / PI; }
+constexpr GLfloat DegToRad(GLfloat value) { return (value * PI) / 180.0f; }
+
+// Compile-time versions for constant data (C++14 constexpr). They use double precision series and
+// loops, so they are much slower than SinCos and std::sqrt when they are evaluated at runtime.
+
+constexpr GLfloat ConstSin(GLfloat angle) {
+    // Reduce the angle to [-PI, PI] and sum the Taylor series:
+    double x = angle, pi = 3.14159265358979323846;
+    while (x > pi) x -= 2.0 * pi;
+    while (x < -pi) x += 2.0 * pi;
+    double term = x, sum = x;
+    for (int i = 1; i < 14; ++i) {
+        term *= -x * x / ((2.0 * i) * (2.0 * i + 1.0));
+        sum += term;
+    }
+    return static_cast<GLfloat>(sum);
+}
+
+constexpr GLfloat ConstCos(GLfloat angle) {
+    double x = angle, pi = 3.14159265358979323846;
+    while (x > pi) x -= 2.0 * pi;
+    while (x < -pi) x += 2.0 * pi;
+    double term = 1.0, sum = 1.0;
+    for (int i = 1; i < 14; ++i) {
+        term *= -x * x / ((2.0 * i - 1.0) * (2.0 * i));
+        sum += term;
+    }
+    return static_cast<GLfloat>(sum);
+}
 
-inline GLfloat RadToDeg(GLfloat value) { return (value * 180.0f) / PI; }
-inline GLfloat DegToRad(GLfloat value) { return (value * PI) / 180.0f; }
+constexpr GLfloat ConstSqrt(GLfloat value) {
+    // Newton's method, until the estimate stops changing:
+    if (value <= 0.0f) return 0.0f;
+    double x = value, current = value > 1.0f ? value : 1.0, previous = 0.0;
+    for (int i = 0; i < 64 && current != previous; ++i) {
+        previous = current;
+        current = 0.5 * (current + x / current);
+    }
+    return static_cast<GLfloat>(current);
+}
 
 //----------------------------------------------------------------------------------------------------
 // Vector3D
@@ -52,37 +104,37 @@ private:
     GLfloat x_, y_, z_, w_;
 
 public:
-    Vector3D() : x_(0.0f), y_(0.0f), z_(0.0f), w_(W_AS_VECTOR) {}
-    Vector3D(GLfloat x, GLfloat y, GLfloat z, GLfloat w) : x_(x), y_(y), z_(z), w_(w) {}
-    Vector3D(GLfloat x, GLfloat y, GLfloat z, bool point = false) :
+    constexpr Vector3D() : x_(0.0f), y_(0.0f), z_(0.0f), w_(W_AS_VECTOR) {}
+    constexpr Vector3D(GLfloat x, GLfloat y, GLfloat z, GLfloat w) : x_(x), y_(y), z_(z), w_(w) {}
+    constexpr Vector3D(GLfloat x, GLfloat y, GLfloat z, bool point = false) :
         x_(x), y_(y), z_(z), w_(point ? W_AS_POINT : W_AS_VECTOR) {}
-    Vector3D(const Vector3D & v) : x_(v.x_), y_(v.y_), z_(v.z_), w_(v.w_) {}
+    constexpr Vector3D(const Vector3D & v) : x_(v.x_), y_(v.y_), z_(v.z_), w_(v.w_) {}
 
     // Properties:
-    GLfloat X() const { return x_; }
-    GLfloat Y() const { return y_; }
-    GLfloat Z() const { return z_; }
-    GLfloat W() const { return w_; }
+    constexpr GLfloat X() const { return x_; }
+    constexpr GLfloat Y() const { return y_; }
+    constexpr GLfloat Z() const { return z_; }
+    constexpr GLfloat W() const { return w_; }
 
-    void X(GLfloat value) { x_ = value; }
-    void Y(GLfloat value) { y_ = value; }
-    void Z(GLfloat value) { z_ = value; }
-    void W(GLfloat value) { w_ = value; }
+    constexpr void X(GLfloat value) { x_ = value; }
+    constexpr void Y(GLfloat value) { y_ = value; }
+    constexpr void Z(GLfloat value) { z_ = value; }
+    constexpr void W(GLfloat value) { w_ = value; }
 
-    bool IsVector() const { return (w_ - W_AS_VECTOR) <= W_THRESHOLD; }
-    bool IsPoint() const { return (w_ - W_AS_POINT) <= W_THRESHOLD; }
+    constexpr bool IsVector() const { return (w_ - W_AS_VECTOR) <= W_THRESHOLD; }
+    constexpr bool IsPoint() const { return (w_ - W_AS_POINT) <= W_THRESHOLD; }
 
-    void Set(const Vector3D & v) { x_ = v.x_, y_ = v.y_, z_ = v.z_, w_ = v.w_; }
-    void Set(GLfloat x, GLfloat y, GLfloat z) { x_ = x, y_ = y, z_ = z; }
-    void Set(GLfloat x, GLfloat y, GLfloat z, GLfloat w) { x_ = x, y_ = y, z_ = z, w_ = w; }
+    constexpr void Set(const Vector3D & v) { x_ = v.x_, y_ = v.y_, z_ = v.z_, w_ = v.w_; }
+    constexpr void Set(GLfloat x, GLfloat y, GLfloat z) { x_ = x, y_ = y, z_ = z; }
+    constexpr void Set(GLfloat x, GLfloat y, GLfloat z, GLfloat w) { x_ = x, y_ = y, z_ = z, w_ = w; }
 
-    void Reset() { x_ = 0.0f, y_ = 0.0f, z_ = 0.0f, w_ = W_AS_VECTOR; }
+    constexpr void Reset() { x_ = 0.0f, y_ = 0.0f, z_ = 0.0f, w_ = W_AS_VECTOR; }
 
     // Methods:
     GLfloat Length() const{ return std::sqrt(LengthSquared()); }
-    GLfloat LengthSquared() const { return x_ * x_ + y_ * y_ + z_ * z_; }
+    constexpr GLfloat LengthSquared() const { return x_ * x_ + y_ * y_ + z_ * z_; }
     GLfloat Distance(const Vector3D & rhs) const { return std::sqrt(DistanceSquared(rhs)); }
-    GLfloat DistanceSquared(const Vector3D & rhs) const { return ((*this) - rhs).LengthSquared(); }
+    constexpr GLfloat DistanceSquared(const Vector3D & rhs) const { return ((*this) - rhs).LengthSquared(); }
 
     Vector3D Normalized() const {
         GLfloat norm = Length();
@@ -98,11 +150,11 @@ public:
         return RadToDeg(std::acos(Dot(rhs) / (Length() * rhs.Length())));
     }
 
-    GLfloat Dot(const Vector3D & rhs) const {
+    constexpr GLfloat Dot(const Vector3D & rhs) const {
         return x_ * rhs.x_ + y_ * rhs.y_ + z_ * rhs.z_;
     }
 
-    Vector3D Cross(const Vector3D & rhs) const {
+    constexpr Vector3D Cross(const Vector3D & rhs) const {
         return Vector3D(
             y_ * rhs.z_ - z_ * rhs.y_, z_ * rhs.x_ - x_ * rhs.z_,
             x_ * rhs.y_ - y_ * rhs.x_, W_AS_VECTOR
@@ -110,96 +162,258 @@ public:
     }
 
     // Operators:
-    Vector3D & operator =(const Vector3D & rhs) {
+    constexpr Vector3D & operator =(const Vector3D & rhs) {
         Set(rhs); return *this;
     }
 
-    bool operator ==(const Vector3D & rhs) const {
+    constexpr bool operator ==(const Vector3D & rhs) const {
         return x_ == rhs.x_ && y_ == rhs.y_ && z_ == rhs.z_ && w_ == rhs.w_;
     }
 
-    bool operator !=(const Vector3D & rhs) const {
+    constexpr bool operator !=(const Vector3D & rhs) const {
         return x_ != rhs.x_ || y_ != rhs.y_ || z_ != rhs.z_ || w_ != rhs.w_;
     }
 
-    Vector3D operator -() const {
+    constexpr Vector3D operator -() const {
         return Vector3D(-x_, -y_, -z_, w_);
     }
 
-    Vector3D operator +(const Vector3D & rhs) const {
+    constexpr Vector3D operator +(const Vector3D & rhs) const {
         return Vector3D(x_ + rhs.x_, y_ + rhs.y_, z_ + rhs.z_, w_ >= rhs.w_ ? w_ : rhs.w_);
     }
 
-    Vector3D operator -(const Vector3D & rhs) const {
+    constexpr Vector3D operator -(const Vector3D & rhs) const {
         return Vector3D(x_ - rhs.x_, y_ - rhs.y_, z_ - rhs.z_, w_ >= rhs.w_ ? w_ : rhs.w_);
     }
 
-    Vector3D operator *(const Vector3D & rhs) const {
+    constexpr Vector3D operator *(const Vector3D & rhs) const {
         return Vector3D(x_ * rhs.x_, y_ * rhs.y_, z_ * rhs.z_, w_ >= rhs.w_ ? w_ : rhs.w_);
     }
 
-    Vector3D operator /(const Vector3D & rhs) const {
+    constexpr Vector3D operator /(const Vector3D & rhs) const {
         return Vector3D(x_ / rhs.x_, y_ / rhs.y_, z_ / rhs.z_, w_ >= rhs.w_ ? w_ : rhs.w_);
     }
 
-    friend Vector3D operator *(const Vector3D & lhs, GLfloat rhs);
-    friend Vector3D operator *(GLfloat lhs, const Vector3D & rhs);
-    friend Vector3D operator /(const Vector3D & lhs, GLfloat rhs);
-    friend Vector3D operator /(GLfloat lhs, const Vector3D & rhs);
+    // In place operators (no temporaries, w is kept as it is):
+    constexpr Vector3D & operator +=(const Vector3D & rhs) {
+        x_ += rhs.x_, y_ += rhs.y_, z_ += rhs.z_; return *this;
+    }
+
+    constexpr Vector3D & operator -=(const Vector3D & rhs) {
+        x_ -= rhs.x_, y_ -= rhs.y_, z_ -= rhs.z_; return *this;
+    }
+
+    constexpr Vector3D & operator *=(GLfloat rhs) {
+        x_ *= rhs, y_ *= rhs, z_ *= rhs; return *this;
+    }
+
+    constexpr Vector3D & operator /=(GLfloat rhs) {
+        x_ /= rhs, y_ /= rhs, z_ /= rhs; return *this;
+    }
+
+    constexpr Vector3D & AddScaled(const Vector3D & direction, GLfloat amount) {
+        x_ += direction.x_ * amount, y_ += direction.y_ * amount, z_ += direction.z_ * amount;
+        return *this;
+    }
+
+    friend constexpr Vector3D operator *(const Vector3D & lhs, GLfloat rhs);
+    friend constexpr Vector3D operator *(GLfloat lhs, const Vector3D & rhs);
+    friend constexpr Vector3D operator /(const Vector3D & lhs, GLfloat rhs);
+    friend constexpr Vector3D operator /(GLfloat lhs, const Vector3D & rhs);
 
     friend Matrix;
 };
 
-Vector3D operator *(const Vector3D & lhs, GLfloat rhs) {
+constexpr Vector3D operator *(const Vector3D & lhs, GLfloat rhs) {
     return Vector3D(lhs.x_ * rhs, lhs.y_ * rhs, lhs.z_ * rhs, lhs.w_);
 }
 
-Vector3D operator *(GLfloat lhs, const Vector3D & rhs) {
+constexpr Vector3D operator *(GLfloat lhs, const Vector3D & rhs) {
     return Vector3D(rhs.x_ * lhs, rhs.y_ * lhs, rhs.z_ * lhs, rhs.w_);
 }
 
-Vector3D operator /(const Vector3D & lhs, GLfloat rhs) {
+constexpr Vector3D operator /(const Vector3D & lhs, GLfloat rhs) {
     return Vector3D(lhs.x_ / rhs, lhs.y_ / rhs, lhs.z_ / rhs, lhs.w_);
 }
 
-Vector3D operator /(GLfloat lhs, const Vector3D & rhs) {
+constexpr Vector3D operator /(GLfloat lhs, const Vector3D & rhs) {
     return Vector3D(rhs.x_ / lhs, rhs.y_ / lhs, rhs.z_ / lhs, rhs.w_);
 }
 
+//----------------------------------------------------------------------------------------------------
+// Quaternion
+//----------------------------------------------------------------------------------------------------
+
+// Rotation quaternion (x, y, z are the vector part and w is the scalar part).
+
+class Quaternion {
+private:
+    GLfloat x_, y_, z_, w_;
+
+public:
+    constexpr Quaternion() : x_(0.0f), y_(0.0f), z_(0.0f), w_(1.0f) {}
+    constexpr Quaternion(GLfloat x, GLfloat y, GLfloat z, GLfloat w) : x_(x), y_(y), z_(z), w_(w) {}
+    constexpr Quaternion(const Quaternion & v) : x_(v.x_), y_(v.y_), z_(v.z_), w_(v.w_) {}
+
+    static Quaternion FromAxisAngle(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+        // The angle is in degrees, like in glRotatef:
+        GLfloat s, c;
+        SinCos(DegToRad(angle) * 0.5f, s, c);
+        s /= std::sqrt(x * x + y * y + z * z);
+        return Quaternion(x * s, y * s, z * s, c);
+    }
+
+    static constexpr Quaternion FromAxisAngleConst(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+        // Same as FromAxisAngle, but it can be evaluated at compile time:
+        GLfloat s = ConstSin(DegToRad(angle) * 0.5f) / ConstSqrt(x * x + y * y + z * z);
+        return Quaternion(x * s, y * s, z * s, ConstCos(DegToRad(angle) * 0.5f));
+    }
+
+    // Properties:
+    constexpr GLfloat X() const { return x_; }
+    constexpr GLfloat Y() const { return y_; }
+    constexpr GLfloat Z() const { return z_; }
+    constexpr GLfloat W() const { return w_; }
+
+    constexpr bool IsIdentity() const { return x_ == 0.0f && y_ == 0.0f && z_ == 0.0f && w_ == 1.0f; }
+
+    // Methods:
+    GLfloat Length() const { return std::sqrt(x_ * x_ + y_ * y_ + z_ * z_ + w_ * w_); }
+
+    void Normalize() {
+        GLfloat norm = Length();
+        x_ /= norm, y_ /= norm, z_ /= norm, w_ /= norm;
+    }
+
+    constexpr Vector3D Rotate(const Vector3D & v) const {
+        // v' = v + w * t + u x t, where t = 2 * (u x v) and u = (x, y, z):
+        GLfloat tx = 2.0f * (y_ * v.Z() - z_ * v.Y());
+        GLfloat ty = 2.0f * (z_ * v.X() - x_ * v.Z());
+        GLfloat tz = 2.0f * (x_ * v.Y() - y_ * v.X());
+        return Vector3D(
+            v.X() + w_ * tx + (y_ * tz - z_ * ty),
+            v.Y() + w_ * ty + (z_ * tx - x_ * tz),
+            v.Z() + w_ * tz + (x_ * ty - y_ * tx),
+            v.W()
+        );
+    }
+
+    // Operators:
+    constexpr Quaternion & operator =(const Quaternion & rhs) {
+        x_ = rhs.x_, y_ = rhs.y_, z_ = rhs.z_, w_ = rhs.w_;
+        return *this;
+    }
+
+    constexpr Quaternion operator *(const Quaternion & rhs) const {
+        return Quaternion(
+            w_ * rhs.x_ + x_ * rhs.w_ + y_ * rhs.z_ - z_ * rhs.y_,
+            w_ * rhs.y_ - x_ * rhs.z_ + y_ * rhs.w_ + z_ * rhs.x_,
+            w_ * rhs.z_ + x_ * rhs.y_ - y_ * rhs.x_ + z_ * rhs.w_,
+            w_ * rhs.w_ - x_ * rhs.x_ - y_ * rhs.y_ - z_ * rhs.z_
+        );
+    }
+};
+
 //----------------------------------------------------------------------------------------------------
 // Matrix
 //----------------------------------------------------------------------------------------------------
 
+// The Add* and Multiply methods are computed in the CPU, so they don't need a current OpenGL
+// context. Define GMATH_OPENGL_MATRIX_STACK to use the old implementation based on the OpenGL
+// matrix stack (push, glTranslatef/glRotatef/..., glGetFloatv and pop).
+
 class Matrix {
 private:
     static const int LEN4 = 4;
     static const int LEN = 16;
-    GLfloat data_[LEN];
+    alignas(16) GLfloat data_[LEN];
 
-    inline int getIndex(int row, int col) const {
+    constexpr int getIndex(int row, int col) const {
         return col * LEN4 + row;
     }
 
-    inline GLfloat get(int i, int j) const {
+    constexpr GLfloat get(int i, int j) const {
         return data_[getIndex(i, j)];
     }
 
-    inline void set(int i, int j, GLfloat v) {
+    constexpr void set(int i, int j, GLfloat v) {
         data_[getIndex(i, j)] = v;
     }
 
+    // Multiplies two column-major 4x4 matrices (r = a * b), r can be the same as a or b:
+    static void multiply(const GLfloat * a, const GLfloat * b, GLfloat * r) {
+#if defined(GMATH_AVX)
+        __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a));
+        __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 4));
+        __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 8));
+        __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 12));
+        __m256 b01 = _mm256_loadu_ps(b);
+        __m256 b23 = _mm256_loadu_ps(b + 8);
+        __m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+        __m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+        r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_shuffle_ps(b01, b01, 0x55)));
+        r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_shuffle_ps(b23, b23, 0x55)));
+        r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_shuffle_ps(b01, b01, 0xAA)));
+        r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_shuffle_ps(b23, b23, 0xAA)));
+        r01 = _mm256_add_ps(r01, _mm256_mul_ps(a3, _mm256_shuffle_ps(b01, b01, 0xFF)));
+        r23 = _mm256_add_ps(r23, _mm256_mul_ps(a3, _mm256_shuffle_ps(b23, b23, 0xFF)));
+        _mm256_storeu_ps(r, r01);
+        _mm256_storeu_ps(r + 8, r23);
+#elif defined(GMATH_SSE)
+        __m128 a0 = _mm_loadu_ps(a);
+        __m128 a1 = _mm_loadu_ps(a + 4);
+        __m128 a2 = _mm_loadu_ps(a + 8);
+        __m128 a3 = _mm_loadu_ps(a + 12);
+        __m128 column[LEN4];
+        for (int j = 0; j < LEN4; ++j) {
+            const GLfloat * bj = b + j * LEN4;
+            __m128 v = _mm_mul_ps(a0, _mm_set1_ps(bj[0]));
+            v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+            v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+            v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_set1_ps(bj[3])));
+            column[j] = v;
+        }
+        for (int j = 0; j < LEN4; ++j) {
+            _mm_storeu_ps(r + j * LEN4, column[j]);
+        }
+#else
+        GLfloat temp[LEN];
+        for (int j = 0; j < LEN4; ++j) {
+            for (int i = 0; i < LEN4; ++i) {
+                // Row x Column:
+                GLfloat v = 0.0f;
+                for (int k = 0; k < LEN4; ++k) {
+                    v += a[k * LEN4 + i] * b[j * LEN4 + k];
+                }
+                temp[j * LEN4 + i] = v;
+            }
+        }
+        std::memcpy(r, temp, LEN * sizeof(GLfloat));
+#endif
+    }
+
 public:
-    Matrix() {
+    constexpr Matrix() : data_() {
         SetAsIdentity();
     }
 
-    Matrix(const Matrix & v) {
-        std::memcpy(data_, v.data_, LEN * sizeof(GLfloat));
+    constexpr Matrix(const Matrix & v) : data_() {
+        for (int i = 0; i < LEN; ++i) {
+            data_[i] = v.data_[i];
+        }
     }
 
     // Properties:
     const GLfloat * Data() const { return data_; }
 
+    void SetFromData(const GLfloat * data) {
+        std::memcpy(data_, data, LEN * sizeof(GLfloat));
+    }
+
+    bool IsAffine() const {
+        return get(3, 0) == 0.0f && get(3, 1) == 0.0f && get(3, 2) == 0.0f && get(3, 3) == 1.0f;
+    }
+
     // OpenGL Methods:
     void LoadFromOpenGL() {
         glGetFloatv(GL_MODELVIEW_MATRIX, data_);
@@ -213,6 +427,7 @@ public:
         glMultMatrixf(data_);
     }
 
+#ifdef GMATH_OPENGL_MATRIX_STACK
     void LoadIdentity() {
         glPushMatrix();
         glLoadIdentity();
@@ -261,6 +476,47 @@ public:
         glPopMatrix();
         return result;
     }
+#else
+    void LoadIdentity() {
+        SetAsIdentity();
+    }
+
+    void AddTranslate(GLfloat x, GLfloat y, GLfloat z) {
+        // Only the last column changes: M * T = [c0 c1 c2 c0*x+c1*y+c2*z+c3]
+        for (int i = 0; i < LEN4; ++i) {
+            set(i, 3, get(i, 0) * x + get(i, 1) * y + get(i, 2) * z + get(i, 3));
+        }
+    }
+
+    void AddScale(GLfloat x, GLfloat y, GLfloat z) {
+        // Only the first three columns change: M * S = [c0*x c1*y c2*z c3]
+        for (int i = 0; i < LEN4; ++i) {
+            set(i, 0, get(i, 0) * x);
+            set(i, 1, get(i, 1) * y);
+            set(i, 2, get(i, 2) * z);
+        }
+    }
+
+    void AddRotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+        // Same as glRotatef: the angle is in degrees and the axis is normalized.
+        GLfloat norm = std::sqrt(x * x + y * y + z * z);
+        if (norm > 0.0f) {
+            Matrix rotation;
+            rotation.SetAsRotate(DegToRad(angle), x / norm, y / norm, z / norm);
+            multiply(data_, rotation.data_, data_);
+        }
+    }
+
+    void AddMultiply(const Matrix & rhs) {
+        multiply(data_, rhs.data_, data_);
+    }
+
+    Matrix Multiply(const Matrix & rhs) const {
+        Matrix result(*this);
+        multiply(data_, rhs.data_, result.data_);
+        return result;
+    }
+#endif
 
     inline void AddTranslate(const Vector3D & v) {
         AddTranslate(v.X(), v.Y(), v.Z());
@@ -275,7 +531,7 @@ public:
     }
 
     // Methods:
-    void SetAsIdentity() {
+    constexpr void SetAsIdentity() {
         for (int i = 0, k = 0; i < LEN4; ++i) {
             for (int j = 0; j < LEN4; ++j, ++k) {
                 data_[k] = i == j ? 1.0f : 0.0f;
@@ -283,14 +539,14 @@ public:
         }
     }
 
-    void SetAsTranslate(GLfloat x, GLfloat y, GLfloat z) {
+    constexpr void SetAsTranslate(GLfloat x, GLfloat y, GLfloat z) {
         SetAsIdentity();
         set(0, 3, x);
         set(1, 3, y);
         set(2, 3, z);
     }
 
-    void SetAsScale(GLfloat x, GLfloat y, GLfloat z) {
+    constexpr void SetAsScale(GLfloat x, GLfloat y, GLfloat z) {
         SetAsIdentity();
         set(0, 0, x);
         set(1, 1, y);
@@ -298,22 +554,22 @@ public:
     }
 
     void SetAsRotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
-        GLfloat c = std::cosf(angle);
-        GLfloat s = std::sinf(angle);
-        GLfloat t = 1.0f - std::cosf(angle);
+        GLfloat s, c;
+        SinCos(angle, s, c);
+        GLfloat t = 1.0f - c;
 
         set(0, 0, t * x * x + c);
-        set(0, 1, t * x * y + s * z);
-        set(0, 2, t * x * z - s * y);
+        set(0, 1, t * x * y - s * z);
+        set(0, 2, t * x * z + s * y);
         set(0, 3, 0.0f);
 
-        set(1, 0, t * x * y - s * z);
+        set(1, 0, t * x * y + s * z);
         set(1, 1, t * y * y + c);
-        set(1, 2, t * y * z + s * x);
+        set(1, 2, t * y * z - s * x);
         set(1, 3, 0.0f);
 
-        set(2, 0, t * x * y + s * y);
-        set(2, 1, t * y * z - s * x);
+        set(2, 0, t * x * z - s * y);
+        set(2, 1, t * y * z + s * x);
         set(2, 2, t * z * z + c);
         set(2, 3, 0.0f);
 
@@ -324,27 +580,91 @@ public:
     }
 
     void SetAsRotateX(GLfloat angle) {
+        GLfloat s, c;
+        SinCos(angle, s, c);
         SetAsIdentity();
-        set(1, 1, std::cosf(angle));
-        set(1, 2, -std::sinf(angle));
-        set(2, 1, std::sinf(angle));
-        set(2, 2, std::cosf(angle));
+        set(1, 1, c);
+        set(1, 2, -s);
+        set(2, 1, s);
+        set(2, 2, c);
     }
 
     void SetAsRotateY(GLfloat angle) {
+        GLfloat s, c;
+        SinCos(angle, s, c);
         SetAsIdentity();
-        set(0, 0, std::cosf(angle));
-        set(0, 2, std::sinf(angle));
-        set(2, 0, -std::sinf(angle));
-        set(2, 2, std::cosf(angle));
+        set(0, 0, c);
+        set(0, 2, s);
+        set(2, 0, -s);
+        set(2, 2, c);
     }
 
     void SetAsRotateZ(GLfloat angle) {
+        GLfloat s, c;
+        SinCos(angle, s, c);
         SetAsIdentity();
-        set(0, 0, std::cosf(angle));
-        set(0, 1, -std::sinf(angle));
-        set(1, 0, std::sinf(angle));
-        set(1, 1, std::cosf(angle));
+        set(0, 0, c);
+        set(0, 1, -s);
+        set(1, 0, s);
+        set(1, 1, c);
+    }
+
+    void SetAsTransform(const Vector3D & translation, const Quaternion & rotation, const Vector3D & scale) {
+        // T * R * S, the rotation must be normalized:
+        GLfloat x = rotation.X(), y = rotation.Y(), z = rotation.Z(), w = rotation.W();
+        GLfloat xx = x * x, yy = y * y, zz = z * z;
+        GLfloat xy = x * y, xz = x * z, yz = y * z;
+        GLfloat wx = w * x, wy = w * y, wz = w * z;
+
+        set(0, 0, (1.0f - 2.0f * (yy + zz)) * scale.X());
+        set(1, 0, (2.0f * (xy + wz)) * scale.X());
+        set(2, 0, (2.0f * (xz - wy)) * scale.X());
+        set(3, 0, 0.0f);
+
+        set(0, 1, (2.0f * (xy - wz)) * scale.Y());
+        set(1, 1, (1.0f - 2.0f * (xx + zz)) * scale.Y());
+        set(2, 1, (2.0f * (yz + wx)) * scale.Y());
+        set(3, 1, 0.0f);
+
+        set(0, 2, (2.0f * (xz + wy)) * scale.Z());
+        set(1, 2, (2.0f * (yz - wx)) * scale.Z());
+        set(2, 2, (1.0f - 2.0f * (xx + yy)) * scale.Z());
+        set(3, 2, 0.0f);
+
+        set(0, 3, translation.X());
+        set(1, 3, translation.Y());
+        set(2, 3, translation.Z());
+        set(3, 3, 1.0f);
+    }
+
+    constexpr void SetAsRotateConst(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+        // Same as SetAsRotate, but it can be evaluated at compile time:
+        GLfloat c = ConstCos(angle), s = ConstSin(angle), t = 1.0f - c;
+        SetAsIdentity();
+        set(0, 0, t * x * x + c);
+        set(0, 1, t * x * y - s * z);
+        set(0, 2, t * x * z + s * y);
+        set(1, 0, t * x * y + s * z);
+        set(1, 1, t * y * y + c);
+        set(1, 2, t * y * z - s * x);
+        set(2, 0, t * x * z - s * y);
+        set(2, 1, t * y * z + s * x);
+        set(2, 2, t * z * z + c);
+    }
+
+    static constexpr Matrix MultiplyConst(const Matrix & lhs, const Matrix & rhs) {
+        // Same as operator *, but it can be evaluated at compile time:
+        Matrix result;
+        for (int i = 0; i < LEN4; ++i) {
+            for (int j = 0; j < LEN4; ++j) {
+                GLfloat v = 0.0f;
+                for (int k = 0; k < LEN4; ++k) {
+                    v += lhs.get(i, k) * rhs.get(k, j);
+                }
+                result.set(i, j, v);
+            }
+        }
+        return result;
     }
 
     inline void SetAsTranslate(const Vector3D & v) {
@@ -360,8 +680,10 @@ public:
     }
 
     // Operators:
-    Matrix & operator =(const Matrix & rhs) {
-        std::memcpy(data_, rhs.data_, LEN * sizeof(GLfloat));
+    constexpr Matrix & operator =(const Matrix & rhs) {
+        for (int i = 0; i < LEN; ++i) {
+            data_[i] = rhs.data_[i];
+        }
         return *this;
     }
 
@@ -384,17 +706,8 @@ public:
     }
 
     Matrix operator *(const Matrix & rhs) const {
-        Matrix result;
-        for (int i = 0; i < LEN4; ++i) {
-            for (int j = 0; j < LEN4; ++j) {
-                // Row x Column:
-                GLfloat v = 0.0f;
-                for (int k = 0; k < LEN4; ++k) {
-                    v += get(i, k) * rhs.get(k, j);
-                }
-                result.set(i, j, v);
-            }
-        }
+        Matrix result(*this);
+        multiply(data_, rhs.data_, result.data_);
         return result;
     }
 
@@ -406,6 +719,507 @@ public:
             get(3, 0) * rhs.x_ + get(3, 1) * rhs.y_ + get(3, 2) * rhs.z_ + get(3, 3) * rhs.w_
         );
     }
+
+    // Batch methods:
+    void Transform(const Vector3D * source, Vector3D * destination, std::size_t count) const {
+        // Same as operator *, the w component of each vector is used:
+        const GLfloat * src = &source->x_;
+        GLfloat * dst = &destination->x_;
+        std::size_t i = 0;
+#if defined(GMATH_AVX)
+        __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(data_));
+        __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(data_ + 4));
+        __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(data_ + 8));
+        __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(data_ + 12));
+        for (; i + 8 <= count; i += 8) {
+            // Two vectors for each register, eight vectors for each iteration:
+            for (int k = 0; k < 2 * LEN; k += 8) {
+                __m256 v = _mm256_loadu_ps(src + i * LEN4 + k);
+                __m256 r = _mm256_mul_ps(c0, _mm256_shuffle_ps(v, v, 0x00));
+                r = _mm256_add_ps(r, _mm256_mul_ps(c1, _mm256_shuffle_ps(v, v, 0x55)));
+                r = _mm256_add_ps(r, _mm256_mul_ps(c2, _mm256_shuffle_ps(v, v, 0xAA)));
+                r = _mm256_add_ps(r, _mm256_mul_ps(c3, _mm256_shuffle_ps(v, v, 0xFF)));
+                _mm256_storeu_ps(dst + i * LEN4 + k, r);
+            }
+        }
+#endif
+#if defined(GMATH_SSE)
+        __m128 m0 = _mm_loadu_ps(data_);
+        __m128 m1 = _mm_loadu_ps(data_ + 4);
+        __m128 m2 = _mm_loadu_ps(data_ + 8);
+        __m128 m3 = _mm_loadu_ps(data_ + 12);
+        for (; i + 4 <= count; i += 4) {
+            // Four vectors for each iteration:
+            for (int k = 0; k < LEN; k += 4) {
+                __m128 v = _mm_loadu_ps(src + i * LEN4 + k);
+                __m128 r = _mm_mul_ps(m0, _mm_shuffle_ps(v, v, 0x00));
+                r = _mm_add_ps(r, _mm_mul_ps(m1, _mm_shuffle_ps(v, v, 0x55)));
+                r = _mm_add_ps(r, _mm_mul_ps(m2, _mm_shuffle_ps(v, v, 0xAA)));
+                r = _mm_add_ps(r, _mm_mul_ps(m3, _mm_shuffle_ps(v, v, 0xFF)));
+                _mm_storeu_ps(dst + i * LEN4 + k, r);
+            }
+        }
+#endif
+        for (; i < count; ++i) {
+            destination[i] = (*this) * source[i];
+        }
+    }
+
+    void Transform(const GLfloat * xs, const GLfloat * ys, const GLfloat * zs, GLfloat w,
+        GLfloat * xd, GLfloat * yd, GLfloat * zd, std::size_t count) const {
+        // Structure of arrays version, w is the same for all the items (W_AS_POINT or W_AS_VECTOR):
+        std::size_t i = 0;
+#if defined(GMATH_AVX)
+        __m256 m[LEN];
+        for (int k = 0; k < LEN; ++k) {
+            m[k] = _mm256_set1_ps(data_[k]);
+        }
+        __m256 tx = _mm256_set1_ps(get(0, 3) * w);
+        __m256 ty = _mm256_set1_ps(get(1, 3) * w);
+        __m256 tz = _mm256_set1_ps(get(2, 3) * w);
+        for (; i + 8 <= count; i += 8) {
+            __m256 x = _mm256_loadu_ps(xs + i);
+            __m256 y = _mm256_loadu_ps(ys + i);
+            __m256 z = _mm256_loadu_ps(zs + i);
+            __m256 rx = _mm256_add_ps(tx, _mm256_mul_ps(m[0], x));
+            __m256 ry = _mm256_add_ps(ty, _mm256_mul_ps(m[1], x));
+            __m256 rz = _mm256_add_ps(tz, _mm256_mul_ps(m[2], x));
+            rx = _mm256_add_ps(rx, _mm256_mul_ps(m[4], y));
+            ry = _mm256_add_ps(ry, _mm256_mul_ps(m[5], y));
+            rz = _mm256_add_ps(rz, _mm256_mul_ps(m[6], y));
+            rx = _mm256_add_ps(rx, _mm256_mul_ps(m[8], z));
+            ry = _mm256_add_ps(ry, _mm256_mul_ps(m[9], z));
+            rz = _mm256_add_ps(rz, _mm256_mul_ps(m[10], z));
+            _mm256_storeu_ps(xd + i, rx);
+            _mm256_storeu_ps(yd + i, ry);
+            _mm256_storeu_ps(zd + i, rz);
+        }
+#endif
+#if defined(GMATH_SSE)
+        __m128 n[LEN];
+        for (int k = 0; k < LEN; ++k) {
+            n[k] = _mm_set1_ps(data_[k]);
+        }
+        __m128 sx = _mm_set1_ps(get(0, 3) * w);
+        __m128 sy = _mm_set1_ps(get(1, 3) * w);
+        __m128 sz = _mm_set1_ps(get(2, 3) * w);
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(xs + i);
+            __m128 y = _mm_loadu_ps(ys + i);
+            __m128 z = _mm_loadu_ps(zs + i);
+            __m128 rx = _mm_add_ps(sx, _mm_mul_ps(n[0], x));
+            __m128 ry = _mm_add_ps(sy, _mm_mul_ps(n[1], x));
+            __m128 rz = _mm_add_ps(sz, _mm_mul_ps(n[2], x));
+            rx = _mm_add_ps(rx, _mm_mul_ps(n[4], y));
+            ry = _mm_add_ps(ry, _mm_mul_ps(n[5], y));
+            rz = _mm_add_ps(rz, _mm_mul_ps(n[6], y));
+            rx = _mm_add_ps(rx, _mm_mul_ps(n[8], z));
+            ry = _mm_add_ps(ry, _mm_mul_ps(n[9], z));
+            rz = _mm_add_ps(rz, _mm_mul_ps(n[10], z));
+            _mm_storeu_ps(xd + i, rx);
+            _mm_storeu_ps(yd + i, ry);
+            _mm_storeu_ps(zd + i, rz);
+        }
+#endif
+        for (; i < count; ++i) {
+            GLfloat x = xs[i], y = ys[i], z = zs[i];
+            xd[i] = get(0, 0) * x + get(0, 1) * y + get(0, 2) * z + get(0, 3) * w;
+            yd[i] = get(1, 0) * x + get(1, 1) * y + get(1, 2) * z + get(1, 3) * w;
+            zd[i] = get(2, 0) * x + get(2, 1) * y + get(2, 2) * z + get(2, 3) * w;
+        }
+    }
+
+    inline void Transform(const std::vector<Vector3D> & source, std::vector<Vector3D> & destination) const {
+        destination.resize(source.size());
+        if (!source.empty()) {
+            Transform(source.data(), destination.data(), source.size());
+        }
+    }
+};
+
+//----------------------------------------------------------------------------------------------------
+// AffineMatrix
+//----------------------------------------------------------------------------------------------------
+
+// Affine transform stored as the top 3x4 part of a 4x4 matrix (the last row is always 0 0 0 1),
+// in row-major order so every row is a SIMD register: [ m00 m01 m02 tx ] [ m10 ... ] [ m20 ... ].
+// The multiply needs about a third fewer operations than the Matrix one, and the inverse and the normal
+// matrix are computed with cross products instead of a general 4x4 inversion.
+
+class AffineMatrix {
+private:
+    static const int LEN4 = 4;
+    static const int LEN = 12;
+    alignas(16) GLfloat data_[LEN];
+
+    inline GLfloat get(int i, int j) const {
+        return data_[i * LEN4 + j];
+    }
+
+    inline void set(int i, int j, GLfloat v) {
+        data_[i * LEN4 + j] = v;
+    }
+
+    static void multiply(const GLfloat * a, const GLfloat * b, GLfloat * r) {
+        // r = a * b, with r = a or r = b allowed:
+#ifdef GMATH_SSE
+        __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8);
+        __m128 row[3];
+        for (int i = 0; i < 3; ++i) {
+            const GLfloat * ai = a + i * LEN4;
+            __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ai[0]), b0), _mm_set_ps(ai[3], 0.0f, 0.0f, 0.0f));
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(ai[1]), b1));
+            row[i] = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(ai[2]), b2));
+        }
+        _mm_storeu_ps(r, row[0]);
+        _mm_storeu_ps(r + 4, row[1]);
+        _mm_storeu_ps(r + 8, row[2]);
+#else
+        GLfloat temp[LEN];
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < LEN4; ++j) {
+                temp[i * LEN4 + j] = a[i * LEN4] * b[j] + a[i * LEN4 + 1] * b[LEN4 + j] +
+                                     a[i * LEN4 + 2] * b[2 * LEN4 + j];
+            }
+            temp[i * LEN4 + 3] += a[i * LEN4 + 3];
+        }
+        std::memcpy(r, temp, LEN * sizeof(GLfloat));
+#endif
+    }
+
+    static void inverse(const GLfloat * a, GLfloat * r, bool withTranslation) {
+        // The rows of the inverse-transpose of the 3x3 part are the cross products of the rows
+        // divided by the determinant; the inverse is its transpose, and t' = -inverse * t.
+#ifdef GMATH_SSE
+        __m128 r0 = _mm_loadu_ps(a), r1 = _mm_loadu_ps(a + 4), r2 = _mm_loadu_ps(a + 8);
+        __m128 c0 = cross(r1, r2), c1 = cross(r2, r0), c2 = cross(r0, r1);
+        __m128 det = _mm_mul_ps(r0, c0);
+        det = _mm_add_ps(_mm_add_ss(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 1, 1, 1))),
+                         _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 2, 2, 2)));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(det, det, _MM_SHUFFLE(0, 0, 0, 0)));
+        c0 = _mm_mul_ps(c0, inv), c1 = _mm_mul_ps(c1, inv), c2 = _mm_mul_ps(c2, inv);
+        if (withTranslation) {
+            __m128 t = _mm_mul_ps(c0, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3)));
+            t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3))));
+            t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 3, 3))));
+            t = _mm_sub_ps(_mm_setzero_ps(), t);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, t);
+        }
+        _mm_storeu_ps(r, c0);
+        _mm_storeu_ps(r + 4, c1);
+        _mm_storeu_ps(r + 8, c2);
+#else
+        GLfloat c[3][3];
+        for (int i = 0; i < 3; ++i) {
+            const GLfloat * u = a + ((i + 1) % 3) * LEN4, * v = a + ((i + 2) % 3) * LEN4;
+            c[i][0] = u[1] * v[2] - u[2] * v[1];
+            c[i][1] = u[2] * v[0] - u[0] * v[2];
+            c[i][2] = u[0] * v[1] - u[1] * v[0];
+        }
+        GLfloat inv = 1.0f / (a[0] * c[0][0] + a[1] * c[0][1] + a[2] * c[0][2]);
+        GLfloat t[3] = { a[3], a[LEN4 + 3], a[2 * LEN4 + 3] };
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                r[i * LEN4 + j] = (withTranslation ? c[j][i] : c[i][j]) * inv;
+            }
+        }
+        for (int i = 0; i < 3; ++i) {
+            r[i * LEN4 + 3] = withTranslation ? -(r[i * LEN4] * t[0] + r[i * LEN4 + 1] * t[1] +
+                                                  r[i * LEN4 + 2] * t[2]) : 0.0f;
+        }
+#endif
+    }
+
+#ifdef GMATH_SSE
+    static inline __m128 cross(__m128 a, __m128 b) {
+        // The w component of the result is always zero:
+        __m128 a1 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b1 = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 v = _mm_sub_ps(_mm_mul_ps(a, b1), _mm_mul_ps(a1, b));
+        return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+#endif
+
+public:
+    AffineMatrix() {
+        SetAsIdentity();
+    }
+
+    AffineMatrix(const AffineMatrix & v) {
+        std::memcpy(data_, v.data_, LEN * sizeof(GLfloat));
+    }
+
+    explicit AffineMatrix(const Matrix & v) {
+        // The last row of the matrix is ignored:
+        const GLfloat * m = v.Data();
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < LEN4; ++j) {
+                set(i, j, m[j * LEN4 + i]);
+            }
+        }
+    }
+
+    // Properties:
+    const GLfloat * Data() const { return data_; }
+
+    GLfloat Get(int row, int col) const { return get(row, col); }
+
+    Matrix ToMatrix() const {
+        GLfloat m[16];
+        ToColumnMajor(m);
+        Matrix result;
+        result.SetFromData(m);
+        return result;
+    }
+
+    void ToColumnMajor(GLfloat * m) const {
+        for (int j = 0; j < LEN4; ++j) {
+            m[j * LEN4] = get(0, j);
+            m[j * LEN4 + 1] = get(1, j);
+            m[j * LEN4 + 2] = get(2, j);
+            m[j * LEN4 + 3] = j == 3 ? 1.0f : 0.0f;
+        }
+    }
+
+    // OpenGL Methods:
+    void MultiplyInOpenGL() const {
+        GLfloat m[16];
+        ToColumnMajor(m);
+        glMultMatrixf(m);
+    }
+
+    // Methods:
+    void SetAsIdentity() {
+        for (int i = 0; i < LEN; ++i) {
+            data_[i] = (i % (LEN4 + 1)) == 0 ? 1.0f : 0.0f;
+        }
+    }
+
+    void SetAsTransform(const Vector3D & translation, const Quaternion & rotation, const Vector3D & scale) {
+        // T * R * S, the rotation must be normalized:
+        GLfloat x = rotation.X(), y = rotation.Y(), z = rotation.Z(), w = rotation.W();
+        GLfloat xx = x * x, yy = y * y, zz = z * z;
+        GLfloat xy = x * y, xz = x * z, yz = y * z;
+        GLfloat wx = w * x, wy = w * y, wz = w * z;
+
+        set(0, 0, (1.0f - 2.0f * (yy + zz)) * scale.X());
+        set(0, 1, (2.0f * (xy - wz)) * scale.Y());
+        set(0, 2, (2.0f * (xz + wy)) * scale.Z());
+        set(0, 3, translation.X());
+
+        set(1, 0, (2.0f * (xy + wz)) * scale.X());
+        set(1, 1, (1.0f - 2.0f * (xx + zz)) * scale.Y());
+        set(1, 2, (2.0f * (yz - wx)) * scale.Z());
+        set(1, 3, translation.Y());
+
+        set(2, 0, (2.0f * (xz - wy)) * scale.X());
+        set(2, 1, (2.0f * (yz + wx)) * scale.Y());
+        set(2, 2, (1.0f - 2.0f * (xx + yy)) * scale.Z());
+        set(2, 3, translation.Z());
+    }
+
+    AffineMatrix Inverse() const {
+        AffineMatrix result;
+        inverse(data_, result.data_, true);
+        return result;
+    }
+
+    AffineMatrix NormalMatrix() const {
+        // Inverse-transpose of the 3x3 part, without translation:
+        AffineMatrix result;
+        inverse(data_, result.data_, false);
+        return result;
+    }
+
+    Vector3D TransformNormal(const Vector3D & normal) const {
+        // Only the 3x3 part is used, the result should be normalized when there's scale:
+        return Vector3D(
+            get(0, 0) * normal.X() + get(0, 1) * normal.Y() + get(0, 2) * normal.Z(),
+            get(1, 0) * normal.X() + get(1, 1) * normal.Y() + get(1, 2) * normal.Z(),
+            get(2, 0) * normal.X() + get(2, 1) * normal.Y() + get(2, 2) * normal.Z(),
+            W_AS_VECTOR
+        );
+    }
+
+    // Operators:
+    AffineMatrix & operator =(const AffineMatrix & rhs) {
+        std::memcpy(data_, rhs.data_, LEN * sizeof(GLfloat));
+        return *this;
+    }
+
+    AffineMatrix operator *(const AffineMatrix & rhs) const {
+        AffineMatrix result(*this);
+        multiply(data_, rhs.data_, result.data_);
+        return result;
+    }
+
+    Vector3D operator *(const Vector3D & rhs) const {
+        // The w component selects between point and vector:
+        return Vector3D(
+            get(0, 0) * rhs.X() + get(0, 1) * rhs.Y() + get(0, 2) * rhs.Z() + get(0, 3) * rhs.W(),
+            get(1, 0) * rhs.X() + get(1, 1) * rhs.Y() + get(1, 2) * rhs.Z() + get(1, 3) * rhs.W(),
+            get(2, 0) * rhs.X() + get(2, 1) * rhs.Y() + get(2, 2) * rhs.Z() + get(2, 3) * rhs.W(),
+            rhs.W()
+        );
+    }
+};
+
+//----------------------------------------------------------------------------------------------------
+// Transform3D
+//----------------------------------------------------------------------------------------------------
+
+// Translation, rotation and scale, the 40 bytes read and written when an object is moved:
+
+struct TransformTRS {
+    Quaternion rotation;
+    GLfloat translation[3];
+    GLfloat scale[3];
+
+    TransformTRS() : rotation() {
+        translation[0] = 0.0f, translation[1] = 0.0f, translation[2] = 0.0f;
+        scale[0] = 1.0f, scale[1] = 1.0f, scale[2] = 1.0f;
+    }
+};
+
+static_assert(sizeof(TransformTRS) == 40, "TransformTRS must stay 40 bytes");
+
+// A TransformTRS with the composed matrix and the normal matrix cached until a change. The cache
+// is kept after the TRS and makes the whole transform 144 bytes, so code that only moves objects
+// touches the first 40. The Add* methods work like the Matrix ones (post-multiply, in local space),
+// AddRotate is exact only when the scale is uniform, otherwise the rotation is applied before the
+// scale.
+
+class Transform3D {
+private:
+    TransformTRS trs_;
+    mutable bool dirty_, normalDirty_;
+    mutable AffineMatrix matrix_, normal_;
+
+    void changed() {
+        dirty_ = true;
+        normalDirty_ = true;
+    }
+
+public:
+    Transform3D() : trs_(), dirty_(false), normalDirty_(false), matrix_(), normal_() {}
+
+    Transform3D(const Vector3D & translation, const Quaternion & rotation, const Vector3D & scale) :
+        trs_(), dirty_(true), normalDirty_(true), matrix_(), normal_() {
+        trs_.rotation = rotation;
+        trs_.translation[0] = translation.X(), trs_.translation[1] = translation.Y();
+        trs_.translation[2] = translation.Z();
+        trs_.scale[0] = scale.X(), trs_.scale[1] = scale.Y(), trs_.scale[2] = scale.Z();
+    }
+
+    explicit Transform3D(const Matrix & value) :
+        trs_(), dirty_(true), normalDirty_(true), matrix_(), normal_() {
+        // The matrix must be affine and without shear, the columns give the scale and the rotation:
+        const GLfloat * m = value.Data();
+        GLfloat r[3][3];
+        for (int j = 0; j < 3; ++j) {
+            const GLfloat * column = m + j * 4;
+            trs_.scale[j] = std::sqrt(column[0] * column[0] + column[1] * column[1] + column[2] * column[2]);
+            for (int i = 0; i < 3; ++i) {
+                r[i][j] = trs_.scale[j] != 0.0f ? column[i] / trs_.scale[j] : 0.0f;
+            }
+            trs_.translation[j] = m[12 + j];
+        }
+        GLfloat trace = r[0][0] + r[1][1] + r[2][2];
+        if (trace > 0.0f) {
+            GLfloat k = 0.5f / std::sqrt(trace + 1.0f);
+            trs_.rotation = Quaternion((r[2][1] - r[1][2]) * k, (r[0][2] - r[2][0]) * k,
+                (r[1][0] - r[0][1]) * k, 0.25f / k);
+        } else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+            GLfloat k = 0.5f / std::sqrt(1.0f + r[0][0] - r[1][1] - r[2][2]);
+            trs_.rotation = Quaternion(0.25f / k, (r[0][1] + r[1][0]) * k,
+                (r[0][2] + r[2][0]) * k, (r[2][1] - r[1][2]) * k);
+        } else if (r[1][1] > r[2][2]) {
+            GLfloat k = 0.5f / std::sqrt(1.0f + r[1][1] - r[0][0] - r[2][2]);
+            trs_.rotation = Quaternion((r[0][1] + r[1][0]) * k, 0.25f / k,
+                (r[1][2] + r[2][1]) * k, (r[0][2] - r[2][0]) * k);
+        } else {
+            GLfloat k = 0.5f / std::sqrt(1.0f + r[2][2] - r[0][0] - r[1][1]);
+            trs_.rotation = Quaternion((r[0][2] + r[2][0]) * k, (r[1][2] + r[2][1]) * k,
+                0.25f / k, (r[1][0] - r[0][1]) * k);
+        }
+        trs_.rotation.Normalize();
+    }
+
+    // Properties:
+    const TransformTRS & TRS() const { return trs_; }
+
+    Vector3D Translation() const {
+        return Vector3D(trs_.translation[0], trs_.translation[1], trs_.translation[2], true);
+    }
+    const Quaternion & Rotation() const { return trs_.rotation; }
+    Vector3D Scale() const { return Vector3D(trs_.scale[0], trs_.scale[1], trs_.scale[2]); }
+
+    void Translation(GLfloat x, GLfloat y, GLfloat z) {
+        trs_.translation[0] = x, trs_.translation[1] = y, trs_.translation[2] = z;
+        changed();
+    }
+
+    void Rotation(const Quaternion & value) {
+        trs_.rotation = value;
+        changed();
+    }
+
+    void Scale(GLfloat x, GLfloat y, GLfloat z) {
+        trs_.scale[0] = x, trs_.scale[1] = y, trs_.scale[2] = z;
+        changed();
+    }
+
+    bool IsIdentity() const {
+        return trs_.translation[0] == 0.0f && trs_.translation[1] == 0.0f && trs_.translation[2] == 0.0f &&
+               trs_.scale[0] == 1.0f && trs_.scale[1] == 1.0f && trs_.scale[2] == 1.0f &&
+               trs_.rotation.IsIdentity();
+    }
+
+    const AffineMatrix & GetMatrix() const {
+        if (dirty_) {
+            matrix_.SetAsTransform(Translation(), trs_.rotation, Scale());
+            dirty_ = false;
+        }
+        return matrix_;
+    }
+
+    const AffineMatrix & GetNormalMatrix() const {
+        // The inverse-transpose of R * S is R * S^-1:
+        if (normalDirty_) {
+            Vector3D inverseScale(1.0f / trs_.scale[0], 1.0f / trs_.scale[1], 1.0f / trs_.scale[2]);
+            normal_.SetAsTransform(Vector3D(), trs_.rotation, inverseScale);
+            normalDirty_ = false;
+        }
+        return normal_;
+    }
+
+    // Methods:
+    void LoadIdentity() {
+        *this = Transform3D();
+    }
+
+    void AddTranslate(GLfloat x, GLfloat y, GLfloat z) {
+        Vector3D delta = trs_.rotation.Rotate(Vector3D(x * trs_.scale[0], y * trs_.scale[1], z * trs_.scale[2]));
+        trs_.translation[0] += delta.X(), trs_.translation[1] += delta.Y(), trs_.translation[2] += delta.Z();
+        changed();
+    }
+
+    void AddScale(GLfloat x, GLfloat y, GLfloat z) {
+        trs_.scale[0] *= x, trs_.scale[1] *= y, trs_.scale[2] *= z;
+        changed();
+    }
+
+    void AddRotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+        trs_.rotation = trs_.rotation * Quaternion::FromAxisAngle(angle, x, y, z);
+        trs_.rotation.Normalize();
+        changed();
+    }
+
+    void MultiplyInOpenGL() const {
+        if (!IsIdentity()) {
+            GetMatrix().MultiplyInOpenGL();
+        }
+    }
 };
 
 #endif
@@ -125,6 +125,24 @@ public:
     }
 };
 
+//----------------------------------------------------------------------------------------------------
+// NewellNormal
+//----------------------------------------------------------------------------------------------------
+
+// Normalized face normal by Newell's method, that can be evaluated at compile time.
+
+constexpr Vector3D NewellNormal(const Vector3D * vertex, const GLuint * index, GLuint count) {
+    Vector3D normal;
+    for (GLuint i = 0; i < count; ++i) {
+        const Vector3D & vcur = vertex[index[i]];
+        const Vector3D & vnxt = vertex[index[(i + 1) % count]];
+        normal.X(normal.X() + (vcur.Y() - vnxt.Y()) * (vcur.Z() + vnxt.Z()));
+        normal.Y(normal.Y() + (vcur.Z() - vnxt.Z()) * (vcur.X() + vnxt.X()));
+        normal.Z(normal.Z() + (vcur.X() - vnxt.X()) * (vcur.Y() + vnxt.Y()));
+    }
+    return normal / ConstSqrt(normal.LengthSquared());
+}
+
 //----------------------------------------------------------------------------------------------------
 // FaceWithNormal3D
 //----------------------------------------------------------------------------------------------------
@@ -210,4 +228,52 @@ public:
     }
 };
 
+//----------------------------------------------------------------------------------------------------
+// StaticMesh3D
+//----------------------------------------------------------------------------------------------------
+
+// Mesh over constant data owned by someone else (usually constexpr arrays), where every face has
+// the same number of vertices and one normal. Nothing is copied, so the data stays read-only.
+
+class StaticMesh3D : public IMesh3D  {
+private:
+    const Vector3D * vertex_;
+    const GLuint * index_;
+    const Vector3D * normal_;
+    GLuint faces_, sides_;
+    GLfloat red_, green_, blue_;
+
+public:
+    StaticMesh3D() : vertex_(nullptr), index_(nullptr), normal_(nullptr), faces_(0), sides_(0),
+        red_(1.0f), green_(1.0f), blue_(1.0f) {}
+    StaticMesh3D(const Vector3D * vertex, const GLuint * index, const Vector3D * normal,
+        GLuint faces, GLuint sides) : vertex_(vertex), index_(index), normal_(normal),
+        faces_(faces), sides_(sides), red_(1.0f), green_(1.0f), blue_(1.0f) {}
+    StaticMesh3D(const StaticMesh3D & v) : vertex_(v.vertex_), index_(v.index_), normal_(v.normal_),
+        faces_(v.faces_), sides_(v.sides_), red_(v.red_), green_(v.green_), blue_(v.blue_) {}
+    virtual ~StaticMesh3D() {}
+
+    void SetColor(GLfloat r, GLfloat g, GLfloat b) {
+        red_ = r, green_ = g, blue_ = b;
+    }
+
+    virtual void Draw() const {
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLineWidth(1.0f);
+        glColor3f(red_, green_, blue_);
+        for (GLuint i = 0; i < faces_; ++i) {
+            glBegin(GL_POLYGON);
+            auto & n = normal_[i];
+            glNormal3f(n.X(), n.Y(), n.Z());
+            for (GLuint j = 0; j < sides_; ++j) {
+                auto & v = vertex_[index_[i * sides_ + j]];
+                glVertex3f(v.X(), v.Y(), v.Z());
+            }
+            glEnd();
+        }
+        glPopMatrix();
+    }
+};
+
 #endif
@@ -32,18 +32,33 @@
 
 class Object3D {
 protected:
-    std::shared_ptr<Matrix> transform_;
+    Transform3D transform_;
 
 public:
-    Object3D() : transform_(std::make_shared<Matrix>()) {}
+    Object3D() : transform_() {}
     Object3D(const Object3D & v) : transform_(v.transform_) {}
     virtual ~Object3D() {}
 
-    Matrix & Transform() { return *transform_; }
-    void Transform(const Matrix & value) { *transform_ = value; }
+    Transform3D & Transform() { return transform_; }
+    const Transform3D & Transform() const { return transform_; }
+    void Transform(const Transform3D & value) { transform_ = value; }
 
-    void Transform(Matrix * value) { transform_.reset(value); }
-    void Transform(std::shared_ptr<Matrix> & value) { transform_ = value; }
+    // The old matrix setters, the matrix is decomposed into a TRS when it's set, so a shared matrix
+    // changed later doesn't move the object anymore:
+    [[deprecated("Use Transform(const Transform3D &)")]]
+    void Transform(const Matrix & value) { transform_ = Transform3D(value); }
+
+    [[deprecated("Use Transform(const Transform3D &)")]]
+    void Transform(Matrix * value) {
+        std::unique_ptr<Matrix> owned(value);
+        transform_ = Transform3D(*owned);
+    }
+
+    [[deprecated("Use Transform(const Transform3D &)")]]
+    void Transform(std::shared_ptr<Matrix> & value) { transform_ = Transform3D(*value); }
+
+    const AffineMatrix & TransformMatrix() const { return transform_.GetMatrix(); }
+    const AffineMatrix & NormalMatrix() const { return transform_.GetNormalMatrix(); }
 
     virtual void Draw() const = 0;
 };
@@ -67,9 +82,7 @@ public:
 
     virtual void Draw() const {
         glPushMatrix();
-        if (transform_) {
-            transform_->MultiplyInOpenGL();
-        }
+        transform_.MultiplyInOpenGL();
         std::for_each(std::begin(childs_), std::end(childs_), [] (const SharedObject3D & item) {
             item->Draw();
         });
@@ -136,9 +149,7 @@ public:
 
     virtual void Draw() const {
         glPushMatrix();
-        if (transform_) {
-            transform_->MultiplyInOpenGL();
-        }
+        transform_.MultiplyInOpenGL();
         if (mesh_) {
             mesh_->Draw();
         }
@@ -63,16 +63,19 @@ public:
 
 class BoxMesh {
 private:
-    SimpleMesh3D data_;
+    static constexpr BoxData3D BOX_DATA = Generator3D::BoxData(120.0f);
+    StaticMesh3D data_;
 public:
-    BoxMesh() {
-        data_ = Generator3D::SimpleBox(120.0f);
+    BoxMesh() : data_(BOX_DATA.vertex, &BOX_DATA.face[0][0], BOX_DATA.normal,
+        BoxData3D::FACES, BoxData3D::SIDES) {
         data_.SetColor(1.0f, 0.0f, 0.0f);
     }
-    inline SimpleMesh3D & Data() { return data_; }
+    inline StaticMesh3D & Data() { return data_; }
     inline void Draw() { data_.Draw(); }
 };
 
+constexpr BoxData3D BoxMesh::BOX_DATA;
+
 //****************************************************************************************************
 // Data:
 //****************************************************************************************************
@@ -82,6 +85,26 @@ const GLdouble NEAR_PLANE = -1000.0, FAR_PLANE = 1000.0;
 const GLfloat ROTATE_SPEED = 10.0f;
 const int NUMBER_OF_RODS = 6;
 
+// The placement of each rod is baked at compile time into a read-only table, each matrix turns
+// the rod around the box and then moves it away from the center:
+constexpr GLfloat ROD_DISTANCE = 60.0f;
+
+constexpr Matrix RodTransform(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+    Matrix rotation, translation;
+    rotation.SetAsRotateConst(DegToRad(angle), x, y, z);
+    translation.SetAsTranslate(0.0f, ROD_DISTANCE, 0.0f);
+    return Matrix::MultiplyConst(rotation, translation);
+}
+
+constexpr Matrix ROD_TRANSFORM[NUMBER_OF_RODS] = {
+    RodTransform(0.0f, 0.0f, 0.0f, 1.0f),
+    RodTransform(90.0f, 0.0f, 0.0f, 1.0f),
+    RodTransform(180.0f, 0.0f, 0.0f, 1.0f),
+    RodTransform(270.0f, 0.0f, 0.0f, 1.0f),
+    RodTransform(90.0f, 1.0f, 0.0f, 0.0f),
+    RodTransform(270.0f, 1.0f, 0.0f, 0.0f)
+};
+
 GLsizei  WindowWidth  = WINDOW_WIDTH;
 GLsizei  WindowHeight = WINDOW_HEIGHT;
 GLdouble CurrentScale = 1.0;
@@ -104,7 +127,7 @@ std::shared_ptr<ObjectContainer3D> SceneObject;
 void InitializeResources() {
     BoxMesh box;
     RodMesh rod("staff.outline");
-    BoxModel.reset(new SimpleMesh3D(box.Data()));
+    BoxModel.reset(new StaticMesh3D(box.Data()));
     RodModel.reset(new SimpleMesh3D(rod.Data()));
 
     SceneObject = std::make_shared<ObjectContainer3D>();
@@ -113,19 +136,9 @@ void InitializeResources() {
 
     for (int i = 0; i < NUMBER_OF_RODS; ++i) {
         RodObject[i].reset(new MeshObject3D(RodModel));
+        RodObject[i]->Transform(Transform3D(ROD_TRANSFORM[i]));
         SceneObject->AddChild(RodObject[i]);
     }
-
-    RodObject[1]->Transform().AddRotate(90.0f, 0.0f, 0.0f, 1.0f);
-    RodObject[2]->Transform().AddRotate(180.0f, 0.0f, 0.0f, 1.0f);
-    RodObject[3]->Transform().AddRotate(270.0f, 0.0f, 0.0f, 1.0f);
-    RodObject[4]->Transform().AddRotate(90.0f, 1.0f, 0.0f, 0.0f);
-    RodObject[5]->Transform().AddRotate(270.0f, 1.0f, 0.0f, 0.0f);
-
-    const GLfloat DISTANCE = 60.0f;
-    for (int i = 0; i < NUMBER_OF_RODS; ++i) {
-        RodObject[i]->Transform().AddTranslate(0.0f, DISTANCE, 0.0f);
-    }
 }
 
 //----------------------------------------------------------------------------------------------------
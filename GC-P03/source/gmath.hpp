@@ -27,6 +27,7 @@
 #include <Windows.h>
 #include <gl/GL.h>
 #include <cmath>
+#include "../../GC-Common/source/gtrig.h"
 
 //----------------------------------------------------------------------------------------------------
 // General
@@ -86,12 +87,14 @@ public:
     }
 
     Vector2D Rotate(float angle) const {
-        auto vs = std::sin(DegToRad(angle)), vc = std::cos(DegToRad(angle));
+        GLfloat vs, vc;
+        SinCos(DegToRad(angle), vs, vc);
         return Vector2D(x_ * vc - y_ * vs, x_ * vs + y_ * vc);
     }
 
     Vector2D Rotate(float angle, const Vector2D & center) const {
-        auto vs = std::sin(DegToRad(angle)), vc = std::cos(DegToRad(angle));
+        GLfloat vs, vc;
+        SinCos(DegToRad(angle), vs, vc);
         auto dx = (1.0f - vc) * center.x_ + vs * center.y_;
         auto dy = (1.0f - vc) * center.y_ - vs * center.x_;
         return Vector2D(x_ * vc - y_ * vs + dx, x_ * vs + y_ * vc + dy);
@@ -110,8 +113,8 @@ public:
     }
 
     Vector2D Reflection(const Vector2D & normal) const {
-        auto a = Projection(normal);
-        return (*this) - ((2 * a) * normal);
+        auto a = 2.0f * Projection(normal);
+        return Vector2D(x_ - a * normal.x_, y_ - a * normal.y_);
     }
 
     // Operators:
@@ -139,6 +142,27 @@ public:
         return Vector2D(x_ - rhs.x_, y_ - rhs.y_);
     }
 
+    // In place operators (no temporaries):
+    Vector2D & operator +=(const Vector2D & rhs) {
+        x_ += rhs.x_, y_ += rhs.y_; return *this;
+    }
+
+    Vector2D & operator -=(const Vector2D & rhs) {
+        x_ -= rhs.x_, y_ -= rhs.y_; return *this;
+    }
+
+    Vector2D & operator *=(GLfloat rhs) {
+        x_ *= rhs, y_ *= rhs; return *this;
+    }
+
+    Vector2D & operator /=(GLfloat rhs) {
+        x_ /= rhs, y_ /= rhs; return *this;
+    }
+
+    Vector2D & AddScaled(const Vector2D & direction, GLfloat amount) {
+        x_ += direction.x_ * amount, y_ += direction.y_ * amount; return *this;
+    }
+
     friend Vector2D operator +(const Vector2D & lhs, GLfloat rhs);
     friend Vector2D operator +(GLfloat lhs, const Vector2D & rhs);
     friend Vector2D operator -(const Vector2D & lhs, GLfloat rhs);
@@ -106,9 +106,9 @@ public:
     }
 
     void Move(const Vector2D & offset) {
-        center_ = center_ + offset;
+        center_ += offset;
         std::for_each(std::begin(points_), std::end(points_),
-            [&] (PointInfo & p) { p.vertex = p.vertex + offset; });
+            [&] (PointInfo & p) { p.vertex += offset; });
     }
 
     void Draw() {
@@ -57,8 +57,20 @@ int Core::GetRandom(int max) {
 //----------------------------------------------------------------------------------------------------
 
 Vector2D Core::GetRandomVector(int max) {
-    Vector2D victim((GLfloat)GetRandom(max), 0.0f);
-    return victim.Rotate((float)GetRandom(360));
+    // The angle is a whole number of degrees, so the directions are computed only once:
+    static GLfloat sines[360], cosines[360];
+    static bool initialized = false;
+    if (!initialized) {
+        GLfloat angles[360];
+        for (int i = 0; i < 360; ++i) {
+            angles[i] = DegToRad((GLfloat)i);
+        }
+        SinCos(angles, sines, cosines, 360);
+        initialized = true;
+    }
+    GLfloat length = (GLfloat)GetRandom(max);
+    int angle = GetRandom(360);
+    return Vector2D(length * cosines[angle], length * sines[angle]);
 }
 
 //----------------------------------------------------------------------------------------------------